@@ -421,10 +421,15 @@ extern "C" D3_RENDER_STREAM_API RS_ERROR rs_setFollower(int isFollower); // Used
 extern "C" D3_RENDER_STREAM_API RS_ERROR rs_beginFollowerFrame(double tTracked); // Pass the engine-distributed tTracked value in, if you have called rs_setFollower(1) otherwise do not call this function.
 
 extern "C" D3_RENDER_STREAM_API RS_ERROR rs_getFrameParameters(uint64_t schemaHash, /*Out*/void* outParameterData, uint64_t outParameterDataSize);  // returns the remote parameters for this frame.
+extern "C" D3_RENDER_STREAM_API RS_ERROR rs_getFrameParametersRange(uint64_t schemaHash, uint64_t offset, /*Out*/void* outParameterData, uint64_t outParameterDataSize);  // returns (outParameterDataSize) bytes of the remote parameters for this frame, starting (offset) bytes in. Proposed optional extension - may not be exported.
 extern "C" D3_RENDER_STREAM_API RS_ERROR rs_getFrameImageData(uint64_t schemaHash, /*Out*/ImageFrameData* outParameterData, uint64_t outParameterDataCount);  // returns the remote image data for this frame.
 extern "C" D3_RENDER_STREAM_API RS_ERROR rs_getFrameImage2(int64_t imageId, /*InOut*/ const SenderFrame* frame); // fills in (data) with the remote image
 extern "C" D3_RENDER_STREAM_API RS_ERROR rs_getFrameText(uint64_t schemaHash, uint32_t textParamIndex, /*Out*/const char** outTextPtr); // // returns the remote text data (pointer only valid until next rs_awaitFrameData)
 
+extern "C" D3_RENDER_STREAM_API RS_ERROR rs_getFrameEvents(uint64_t schemaHash, uint32_t eventParamIndex, /*Out*/uint32_t* outTriggerCount); // returns the number of times the event parameter was triggered since the previous call, including any frames which were skipped. Proposed optional extension - may not be exported.
+extern "C" D3_RENDER_STREAM_API RS_ERROR rs_getSkeletonLayout(uint64_t schemaHash, uint32_t skeletonParamIndex, /*InOut*/SkeletonLayout* layout, /*InOut*/uint32_t* nJoints); // fills (layout) with the joint hierarchy of the skeleton, into a buffer of (nJoints) joints at layout->joints. Proposed optional extension - may not be exported.
+extern "C" D3_RENDER_STREAM_API RS_ERROR rs_getSkeletonPose(uint64_t schemaHash, uint32_t skeletonParamIndex, /*InOut*/SkeletonPose* pose, /*InOut*/uint32_t* nJoints); // fills (pose) with the local joint transforms of the skeleton for this frame, into a buffer of (nJoints) joints at pose->joints. Proposed optional extension - may not be exported.
+
 extern "C" D3_RENDER_STREAM_API RS_ERROR rs_getFrameCamera(StreamHandle streamHandle, /*Out*/CameraData* outCameraData);  // returns the CameraData for this stream, or RS_ERROR_NOTFOUND if no camera data is available for this stream on this frame
 extern "C" D3_RENDER_STREAM_API RS_ERROR rs_sendFrame2(StreamHandle streamHandle, const SenderFrame* frame, const FrameResponseData* frameData); // publish a frame which was generated from the associated tracking and timing information.
 
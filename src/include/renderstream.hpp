@@ -13,7 +13,22 @@
 #include <vector>
 #include <variant>
 #include <string>
+#include <string_view>
 #include <array>
+#include <tuple>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#include <immintrin.h>
+#define RS_HAS_SSE2 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #pragma comment(lib, "Shlwapi.lib")
 
@@ -24,11 +39,15 @@
 #define DECL_FN(FUNC_NAME) decltype(rs_ ## FUNC_NAME)* m_ ## FUNC_NAME = nullptr
 
 #define LOAD_FN(FUNC_NAME) \
-    m_ ## FUNC_NAME = reinterpret_cast<decltype(rs_ ## FUNC_NAME) *>(GetProcAddress(m_rsDll, "rs_" #FUNC_NAME)); \
+    m_ ## FUNC_NAME = reinterpret_cast<decltype(rs_ ## FUNC_NAME) *>(resolve("rs_" #FUNC_NAME)); \
     if (!m_ ## FUNC_NAME) { \
         throw std::runtime_error("Failed to get function " #FUNC_NAME " from DLL"); \
     }
 
+// Functions which only exist in newer dlls - callers must check for nullptr before use.
+#define LOAD_FN_OPTIONAL(FUNC_NAME) \
+    m_ ## FUNC_NAME = reinterpret_cast<decltype(rs_ ## FUNC_NAME) *>(resolve("rs_" #FUNC_NAME))
+
 class RenderStreamError : public std::runtime_error
 {
 public:
@@ -43,7 +62,146 @@ inline void checkRs(RS_ERROR err, const char* context)
         throw RenderStreamError(err, std::string("Error calling ") + context + " - " + std::to_string(err));
 }
 
+inline uint32_t rsCountTrailingZeros(uint64_t bits)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return index;
+#else
+    return uint32_t(__builtin_ctzll(bits));
+#endif
+}
+
+// FNV-1a, used to detect changes in text parameters.
+inline uint64_t rsHashString(const char* str)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (; str && *str; ++str)
+        hash = (hash ^ uint8_t(*str)) * 1099511628211ull;
+    return hash;
+}
+
+// Sets bit i of (out) if a[i] and b[i] are not bitwise identical, for the first (n) floats. (out) must hold (n + 63) / 64 words.
+inline void rsDiffFloats(const float* a, const float* b, size_t n, uint64_t* out)
+{
+    std::fill(out, out + (n + 63) / 64, 0ull);
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+        const uint64_t changed = ~uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(eq))) & 0xff;
+        out[i / 64] |= changed << (i % 64);
+    }
+#elif defined(RS_HAS_SSE2)
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        const uint64_t changed = ~uint64_t(_mm_movemask_ps(_mm_castsi128_ps(eq))) & 0xf;
+        out[i / 64] |= changed << (i % 64);
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        if (memcmp(a + i, b + i, sizeof(float)) != 0)
+            out[i / 64] |= 1ull << (i % 64);
+    }
+}
+
+inline uint32_t rsBytesPerPixel(RSPixelFormat format)
+{
+    switch (format)
+    {
+    case RS_FMT_BGRA8:
+    case RS_FMT_BGRX8:
+    case RS_FMT_RGBA8:
+    case RS_FMT_RGBX8:
+        return 4;
+    case RS_FMT_RGBA16:
+        return 8;
+    case RS_FMT_RGBA32F:
+        return 16;
+    default:
+        throw std::runtime_error("Unhandled RS pixel format");
+    }
+}
+
+// Number of floats a parameter occupies in the block returned by rs_getFrameParameters, if it is not read-only.
+inline uint32_t rsParameterFloatCount(RemoteParameterType type)
+{
+    switch (type)
+    {
+    case RS_PARAMETER_NUMBER:
+        return 1;
+    case RS_PARAMETER_POSE:
+    case RS_PARAMETER_TRANSFORM:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+// True if any of bits [first, first + count) are set.
+inline bool rsAnyBits(const uint64_t* bits, size_t first, size_t count)
+{
+    for (size_t i = first; i < first + count; ++i)
+    {
+        if (bits[i / 64] & (1ull << (i % 64)))
+            return true;
+    }
+    return false;
+}
+
+
+// Location of a single (non read-only) parameter within the value blocks returned by the dll.
+struct ParameterSlot
+{
+    RemoteParameterType type;
+    uint32_t flags; // REMOTEPARAMETER_FLAGS
+    uint32_t index; // Index into the float, image or text block, depending on type
+    uint32_t iParameter; // Index into RemoteParameters::parameters
+};
+
+// Per-scene parameter state, kept by RenderStream across frames.
+// Parameters flagged REMOTEPARAMETER_NO_SEQUENCE only change when edited by an operator, so they are
+// refreshed at a low cadence rather than every frame.
+struct SceneParameterState
+{
+    inline explicit SceneParameterState(const RemoteParameters& scene);
+
+    std::vector<ParameterSlot> slots;
+    std::unordered_map<std::string, uint32_t> keys; // parameter key -> index into slots
+
+    // [first, count] runs of the float block owned by sequenced parameters
+    std::vector<std::pair<uint32_t, uint32_t>> sequencedFloatRanges;
+    bool hasSequencedImages = false;
+
+    std::vector<float> floatValues;
+    std::vector<ImageFrameData> imageValues;
+    std::vector<char> textArena; // copies of this update's texts, each nul-terminated
+    std::vector<size_t> textOffsets; // into textArena, while it is being filled
+    std::vector<std::string_view> textValues; // into textArena
+    std::vector<uint64_t> textHashes;
+    std::vector<std::vector<SkeletonJointPose>> skeletonJoints; // storage for SkeletonPose::joints, fetched on demand
+    std::vector<uint32_t> eventCounts; // triggers since the previous update
+
+    // Values from the previous update, used to compute the changed mask
+    std::vector<float> previousFloatValues;
+    std::vector<ImageFrameData> previousImageValues;
+    std::vector<uint64_t> previousTextHashes;
+    std::vector<uint64_t> floatChanged; // bit per float
+    std::vector<uint64_t> changed; // bit per slot
+    bool first = true;
+
+    bool stale = true;
+    uint64_t refreshFrame = 0;
+
+    inline void updateChanged();
+};
 
+// View onto the parameter values of a scene for the current frame.
+// Values are owned by RenderStream, and are only valid until the next call to getFrameParameters for the same scene.
 class ParameterValues
 {
 public:
@@ -52,14 +210,87 @@ public:
     template <typename T>
     T get(const std::string& key);
 
+    const RemoteParameters& scene() const { return *m_parameters; }
+
+    // The 16 floats of a pose or transform parameter, without copying
+    inline const float* matrix(const std::string& key);
+    // The whole float block of the scene, in schema order
+    const std::vector<float>& floats() const { return m_state->floatValues; }
+
+    // Index of the parameter (key) within the block of its type, e.g. the skeletonParamIndex of a skeleton parameter
+    inline uint32_t typeIndex(const std::string& key);
+    // Number of joints in the pose last returned by get<SkeletonPose>(key)
+    inline size_t skeletonJointCount(const std::string& key);
+    // Number of times the event parameter (key) was triggered since the previous call to getFrameParameters for this scene.
+    // Always 0 unless RenderStream::supportsEvents().
+    inline uint32_t eventCount(const std::string& key);
+    // FNV-1a hash of the text parameter (key), for comparing texts without reading them
+    inline uint64_t textHash(const std::string& key);
+
+    // Change detection against the previous call to getFrameParameters for this scene.
+    // Every parameter is reported as changed on the first frame of a scene.
+    inline bool changed(const std::string& key);
+    inline bool anyChanged() const;
+    // Bit per non read-only parameter, in schema order
+    inline const std::vector<uint64_t>& changedMask() const;
+    // Calls fn(const RemoteParameter&) for each changed parameter
+    template <typename Fn>
+    void forEachChanged(Fn&& fn) const;
+
 private:
     inline std::tuple<size_t, RemoteParameterType> iKey(const std::string& key);
 
     class RenderStream* m_rs;
     const RemoteParameters* m_parameters;
-    std::vector<float> m_floatValues;
-    std::vector<ImageFrameData> m_imageValues;
-    std::vector<const char*> m_textValues;
+    SceneParameterState* m_state;
+};
+
+// How a slot of the stream table changed in the last rebuild.
+enum StreamChange
+{
+    STREAM_UNCHANGED, // same stream, or a slot which is still free
+    STREAM_CLIPPING_CHANGED, // same stream, size and format, so existing resources can be kept
+    STREAM_RESIZED, // same stream with a new size or format
+    STREAM_ADDED, // new stream; resources left in the slot belong to a removed stream
+    STREAM_REMOVED, // the slot is now free
+};
+
+// Dense structure-of-arrays copy of the current streams, rebuilt by RenderStream::getStreams.
+// A stream keeps its slot for as long as its handle exists, so per-stream data can live in a vector of capacity() elements
+// indexed by slot, with no hashing in the frame loop. Slots of removed streams are reused by later streams.
+// Each rebuild records how every slot changed, so resources only need to be created for new and resized streams.
+//
+// Usage:
+//     for (size_t i = 0; i < header->nStreams; ++i)
+//         if (streams.needsResources(streams.slots[i]))
+//             renderTargets[streams.slots[i]] = createRenderTarget(header->streams[i]);
+struct StreamTable
+{
+    std::vector<StreamHandle> handles;
+    std::vector<uint32_t> widths, heights;
+    std::vector<RSPixelFormat> formats;
+    std::vector<ProjectionClipping> clippings;
+    std::vector<const char*> channels;
+    std::vector<const StreamDescription*> descriptions; // owned by RenderStream, nullptr for free slots
+
+    std::vector<uint32_t> slots; // slot of each stream, in StreamDescriptions order
+    std::vector<StreamChange> changes; // per slot, compared with the previous rebuild
+
+    size_t capacity() const { return handles.size(); }
+    size_t size() const { return slots.size(); }
+    bool used(uint32_t slot) const { return descriptions[slot] != nullptr; }
+    // True if the slot needs new resources: STREAM_ADDED or STREAM_RESIZED
+    bool needsResources(uint32_t slot) const { return changes[slot] == STREAM_ADDED || changes[slot] == STREAM_RESIZED; }
+    // Number of slots with each StreamChange in the last rebuild
+    inline std::array<uint32_t, STREAM_REMOVED + 1> changeCounts() const;
+
+    // Slot of the stream (handle), for use outside the frame loop
+    inline uint32_t slot(StreamHandle handle) const;
+
+    inline void rebuild(const StreamDescriptions& streams);
+
+private:
+    std::unordered_map<StreamHandle, uint32_t> m_slotsByHandle;
 };
 
 template <typename Char, typename Traits>
@@ -98,6 +329,9 @@ public:
     inline ~RenderStream();
 
     inline void initialise();
+    // Loads the RenderStream functions from (resolve), which returns the function exported by the dll as (name), or nullptr.
+    // Used to run against a stand-in for the dll, such as the ClusterEmulator sample.
+    inline void initialise(const std::function<void*(const char* name)>& resolve);
 
     inline void initialiseGpGpuWithDX11Device(ID3D11Device* device);
     inline void initialiseGpGpuWithDX11Resource(ID3D11Resource* resource);
@@ -110,12 +344,34 @@ public:
     inline void setSchema(Schema* schema);
 
     inline ParameterValues getFrameParameters(const RemoteParameters& scene);
+
+    // Non-sequenced parameters are refetched every (frames) frames, on FRAMEDATA_RESET and after invalidateParameterCache.
+    // Only takes effect if the dll supports partial parameter fetches, otherwise all floats are fetched every frame.
+    inline void setNonSequencedRefreshInterval(uint32_t frames);
+    inline void invalidateParameterCache();
     
     inline void getFrameImage(int64_t imageId, /*InOut*/const SenderFrame& data);
+    inline void releaseImage(const SenderFrame& data);
+
+    // Event parameters require a dll which exports rs_getFrameEvents; without it their trigger counts are always 0.
+    inline bool supportsEvents() const;
+
+    // Skeleton parameters require a dll which exports rs_getSkeletonLayout and rs_getSkeletonPose.
+    // Joints are written to (joints), which the returned object points into.
+    inline bool supportsSkeletons() const;
+    inline SkeletonLayout getSkeletonLayout(uint64_t schemaHash, uint32_t iSkeleton, std::vector<SkeletonJointDesc>& joints);
+    inline SkeletonPose getSkeletonPose(uint64_t schemaHash, uint32_t iSkeleton, std::vector<SkeletonJointPose>& joints);
 
     inline std::variant<FrameData, RS_ERROR> awaitFrameData(int timeoutMs);
 
+    // Follower nodes receive FrameData from their controller instead of awaitFrameData - see followers.md.
+    inline void setFollower(bool isFollower);
+    // Returns any of the errors awaitFrameData can return. After RS_ERROR_STREAMS_CHANGED, call again with the same tTracked.
+    inline RS_ERROR beginFollowerFrame(double tTracked);
+
+    // Also rebuilds the stream table
     inline const StreamDescriptions* getStreams();
+    const StreamTable& streams() const { return m_streams; }
 
     inline CameraData getFrameCamera(StreamHandle stream);
 
@@ -129,10 +385,20 @@ public:
 
 private:
     friend class ParameterValues; // uses the various low level parameter accessors
+    inline SceneParameterState& updateParameters(const RemoteParameters& scene);
+
+    static const uint32_t DEFAULT_NON_SEQUENCED_REFRESH_INTERVAL = 30;
+
     HMODULE m_rsDll;
     std::vector<uint8_t> m_streamDescriptionsMemory;
+    StreamTable m_streams;
     std::vector<uint8_t> m_schemaMemory;
 
+    uint64_t m_frameIndex = 0;
+    uint32_t m_nonSequencedRefreshInterval = DEFAULT_NON_SEQUENCED_REFRESH_INTERVAL;
+    std::unordered_map<uint64_t, SceneParameterState> m_parameterStates; // keyed by scene hash
+    bool m_loggedMissingEvents = false;
+
     logger_t m_loggingFunc = nullptr;
     logger_t m_errorLoggingFunc = nullptr;
     logger_t m_verboseLoggingFunc = nullptr;
@@ -154,10 +420,17 @@ private:
     DECL_FN(setSchema);
     DECL_FN(getStreams);
     DECL_FN(getFrameParameters);
+    DECL_FN(getFrameParametersRange);
     DECL_FN(getFrameImageData);
     DECL_FN(getFrameText);
     DECL_FN(getFrameImage2);
+    DECL_FN(releaseImage2);
+    DECL_FN(getFrameEvents);
+    DECL_FN(getSkeletonLayout);
+    DECL_FN(getSkeletonPose);
     DECL_FN(awaitFrameData);
+    DECL_FN(setFollower);
+    DECL_FN(beginFollowerFrame);
     DECL_FN(getFrameCamera);
     DECL_FN(sendFrame2);
     DECL_FN(setNewStatusMessage);
@@ -205,6 +478,11 @@ void RenderStream::initialise()
         throw std::runtime_error(std::string("Failed to load dll: '") + buffer + "'");
     }
 
+    initialise([this](const char* name) { return reinterpret_cast<void*>(GetProcAddress(m_rsDll, name)); });
+}
+
+void RenderStream::initialise(const std::function<void*(const char* name)>& resolve)
+{
     LOAD_FN(registerLoggingFunc);
     LOAD_FN(registerErrorLoggingFunc);
     LOAD_FN(registerVerboseLoggingFunc);
@@ -221,11 +499,18 @@ void RenderStream::initialise()
     LOAD_FN(saveSchema);
     LOAD_FN(setSchema);
     LOAD_FN(getFrameParameters);
+    LOAD_FN_OPTIONAL(getFrameParametersRange);
     LOAD_FN(getFrameImageData);
     LOAD_FN(getFrameText);
     LOAD_FN(getFrameImage2);
+    LOAD_FN(releaseImage2);
+    LOAD_FN_OPTIONAL(getFrameEvents);
+    LOAD_FN_OPTIONAL(getSkeletonLayout);
+    LOAD_FN_OPTIONAL(getSkeletonPose);
     LOAD_FN(getStreams);
     LOAD_FN(awaitFrameData);
+    LOAD_FN(setFollower);
+    LOAD_FN(beginFollowerFrame);
     LOAD_FN(getFrameCamera);
     LOAD_FN(sendFrame2);
     LOAD_FN(setNewStatusMessage);
@@ -312,6 +597,8 @@ void RenderStream::saveSchema(const char* assetPath, Schema* schema)
 void RenderStream::setSchema(Schema* schema)
 {
     checkRs(m_setSchema(schema), __FUNCTION__);
+    // Scene layouts may have changed
+    m_parameterStates.clear();
 }
 
 ParameterValues RenderStream::getFrameParameters(const RemoteParameters& scene)
@@ -319,21 +606,190 @@ ParameterValues RenderStream::getFrameParameters(const RemoteParameters& scene)
     return ParameterValues(*this, scene);
 }
 
+void RenderStream::setNonSequencedRefreshInterval(uint32_t frames)
+{
+    m_nonSequencedRefreshInterval = frames;
+}
+
+void RenderStream::invalidateParameterCache()
+{
+    for (auto& [hash, state] : m_parameterStates)
+        state.stale = true;
+}
+
+SceneParameterState& RenderStream::updateParameters(const RemoteParameters& scene)
+{
+    auto it = m_parameterStates.find(scene.hash);
+    if (it == m_parameterStates.end())
+        it = m_parameterStates.emplace(scene.hash, SceneParameterState(scene)).first;
+    SceneParameterState& state = it->second;
+
+    state.previousFloatValues.assign(state.floatValues.begin(), state.floatValues.end());
+    state.previousImageValues.assign(state.imageValues.begin(), state.imageValues.end());
+    state.previousTextHashes.assign(state.textHashes.begin(), state.textHashes.end());
+
+    const bool refresh = state.stale || m_frameIndex - state.refreshFrame >= m_nonSequencedRefreshInterval;
+    if (refresh || !m_getFrameParametersRange)
+    {
+        checkRs(m_getFrameParameters(scene.hash, state.floatValues.data(), state.floatValues.size() * sizeof(float)), "get frame float data");
+    }
+    else
+    {
+        for (const auto& [first, count] : state.sequencedFloatRanges)
+            checkRs(m_getFrameParametersRange(scene.hash, first * sizeof(float), &state.floatValues[first], count * sizeof(float)), "get frame float data range");
+    }
+
+    if (refresh || state.hasSequencedImages)
+    {
+        checkRs(m_getFrameImageData(scene.hash, state.imageValues.data(), state.imageValues.size()), "get frame image data");
+    }
+
+    // Texts returned by the dll are only valid until the next awaitFrameData, so they are copied into the arena
+    state.textArena.clear();
+    for (size_t iText = 0; iText < state.textValues.size(); ++iText)
+    {
+        const char* text = nullptr;
+        checkRs(m_getFrameText(scene.hash, uint32_t(iText), &text), "get frame text");
+        const size_t length = text ? strlen(text) : 0;
+        state.textOffsets[iText] = state.textArena.size();
+        state.textHashes[iText] = rsHashString(text);
+        state.textArena.insert(state.textArena.end(), text, text + length);
+        state.textArena.push_back('\0');
+    }
+    // The arena has stopped growing, so the views can point into it
+    for (size_t iText = 0; iText < state.textValues.size(); ++iText)
+    {
+        const size_t offset = state.textOffsets[iText];
+        const size_t end = iText + 1 < state.textOffsets.size() ? state.textOffsets[iText + 1] : state.textArena.size();
+        state.textValues[iText] = std::string_view(state.textArena.data() + offset, end - offset - 1);
+    }
+
+    // Event parameters are never reported on dlls without rs_getFrameEvents
+    if (m_getFrameEvents)
+    {
+        for (size_t iEvent = 0; iEvent < state.eventCounts.size(); ++iEvent)
+            checkRs(m_getFrameEvents(scene.hash, uint32_t(iEvent), &state.eventCounts[iEvent]), "get frame events");
+    }
+    else if (!state.eventCounts.empty() && !m_loggedMissingEvents)
+    {
+        m_loggedMissingEvents = true;
+        RS_LOG("Scene '" << scene.name << "' has event parameters, but this RenderStream dll does not export rs_getFrameEvents: their triggers will not be seen");
+    }
+
+    if (refresh)
+    {
+        state.stale = false;
+        state.refreshFrame = m_frameIndex;
+    }
+
+    state.updateChanged();
+    return state;
+}
+
 void RenderStream::getFrameImage(int64_t imageId, const SenderFrame& frame)
 {
     checkRs(m_getFrameImage2(imageId, &frame), __FUNCTION__);
 }
 
+void RenderStream::releaseImage(const SenderFrame& frame)
+{
+    checkRs(m_releaseImage2(&frame), __FUNCTION__);
+}
+
+bool RenderStream::supportsEvents() const
+{
+    return m_getFrameEvents != nullptr;
+}
+
+bool RenderStream::supportsSkeletons() const
+{
+    return m_getSkeletonLayout && m_getSkeletonPose;
+}
+
+SkeletonLayout RenderStream::getSkeletonLayout(uint64_t schemaHash, uint32_t iSkeleton, std::vector<SkeletonJointDesc>& joints)
+{
+    if (!supportsSkeletons())
+        throw std::runtime_error("Skeleton parameters are not supported by this version of RenderStream");
+
+    const static int MAX_TRIES = 3;
+    int iterations = 0;
+
+    SkeletonLayout layout = {};
+    uint32_t nJoints = uint32_t(joints.size());
+    RS_ERROR res = RS_ERROR_BUFFER_OVERFLOW;
+    do
+    {
+        joints.resize(nJoints);
+        layout.joints = joints.data();
+        res = m_getSkeletonLayout(schemaHash, iSkeleton, &layout, &nJoints);
+
+        if (res == RS_ERROR_SUCCESS)
+            break;
+
+        ++iterations;
+    } while (res == RS_ERROR_BUFFER_OVERFLOW && iterations < MAX_TRIES);
+
+    checkRs(res, __FUNCTION__);
+    joints.resize(nJoints);
+    return layout;
+}
+
+SkeletonPose RenderStream::getSkeletonPose(uint64_t schemaHash, uint32_t iSkeleton, std::vector<SkeletonJointPose>& joints)
+{
+    if (!supportsSkeletons())
+        throw std::runtime_error("Skeleton parameters are not supported by this version of RenderStream");
+
+    const static int MAX_TRIES = 3;
+    int iterations = 0;
+
+    SkeletonPose pose = {};
+    uint32_t nJoints = uint32_t(joints.size());
+    RS_ERROR res = RS_ERROR_BUFFER_OVERFLOW;
+    do
+    {
+        joints.resize(nJoints);
+        pose.joints = joints.data();
+        res = m_getSkeletonPose(schemaHash, iSkeleton, &pose, &nJoints);
+
+        if (res == RS_ERROR_SUCCESS)
+            break;
+
+        ++iterations;
+    } while (res == RS_ERROR_BUFFER_OVERFLOW && iterations < MAX_TRIES);
+
+    checkRs(res, __FUNCTION__);
+    joints.resize(nJoints);
+    return pose;
+}
+
 std::variant<FrameData, RS_ERROR> RenderStream::awaitFrameData(int timeoutMs)
 {
     FrameData out;
     RS_ERROR err = m_awaitFrameData(timeoutMs, &out);
     if (err == RS_ERROR_SUCCESS)
+    {
+        ++m_frameIndex;
+        if (out.flags & FRAMEDATA_RESET)
+            invalidateParameterCache();
         return out;
+    }
     else
         return err;
 }
 
+void RenderStream::setFollower(bool isFollower)
+{
+    checkRs(m_setFollower(isFollower ? 1 : 0), __FUNCTION__);
+}
+
+RS_ERROR RenderStream::beginFollowerFrame(double tTracked)
+{
+    RS_ERROR err = m_beginFollowerFrame(tTracked);
+    if (err == RS_ERROR_SUCCESS)
+        ++m_frameIndex;
+    return err;
+}
+
 const StreamDescriptions* RenderStream::getStreams()
 {
     uint32_t nBytes = 0;
@@ -360,7 +816,96 @@ const StreamDescriptions* RenderStream::getStreams()
     if (nBytes < sizeof(StreamDescriptions))
         throw std::runtime_error("Invalid stream descriptions");
 
-    return reinterpret_cast<const StreamDescriptions*>(m_streamDescriptionsMemory.data());
+    const StreamDescriptions* streams = reinterpret_cast<const StreamDescriptions*>(m_streamDescriptionsMemory.data());
+    m_streams.rebuild(*streams);
+    return streams;
+}
+
+uint32_t StreamTable::slot(StreamHandle handle) const
+{
+    auto it = m_slotsByHandle.find(handle);
+    if (it == m_slotsByHandle.end())
+        throw std::runtime_error("Unknown stream handle");
+    return it->second;
+}
+
+std::array<uint32_t, STREAM_REMOVED + 1> StreamTable::changeCounts() const
+{
+    std::array<uint32_t, STREAM_REMOVED + 1> counts = {};
+    for (size_t slot = 0; slot < changes.size(); ++slot)
+    {
+        if (used(uint32_t(slot)) || changes[slot] == STREAM_REMOVED)
+            ++counts[changes[slot]];
+    }
+    return counts;
+}
+
+void StreamTable::rebuild(const StreamDescriptions& streams)
+{
+    std::unordered_map<StreamHandle, uint32_t> previous;
+    previous.swap(m_slotsByHandle);
+    for (size_t slot = 0; slot < descriptions.size(); ++slot)
+    {
+        changes[slot] = descriptions[slot] ? STREAM_REMOVED : STREAM_UNCHANGED;
+        descriptions[slot] = nullptr;
+    }
+
+    // Existing streams keep their slots
+    slots.assign(streams.nStreams, UINT32_MAX);
+    for (uint32_t i = 0; i < streams.nStreams; ++i)
+    {
+        auto it = previous.find(streams.streams[i].handle);
+        if (it != previous.end())
+        {
+            const StreamDescription& description = streams.streams[i];
+            const uint32_t slot = it->second;
+            slots[i] = slot;
+            descriptions[slot] = &description;
+            if (description.width != widths[slot] || description.height != heights[slot] || description.format != formats[slot])
+                changes[slot] = STREAM_RESIZED;
+            else if (memcmp(&description.clipping, &clippings[slot], sizeof(ProjectionClipping)) != 0)
+                changes[slot] = STREAM_CLIPPING_CHANGED;
+            else
+                changes[slot] = STREAM_UNCHANGED;
+        }
+    }
+
+    // New streams take the lowest free slots
+    uint32_t nextFree = 0;
+    for (uint32_t i = 0; i < streams.nStreams; ++i)
+    {
+        if (slots[i] != UINT32_MAX)
+            continue;
+        while (nextFree < descriptions.size() && descriptions[nextFree])
+            ++nextFree;
+        if (nextFree == descriptions.size())
+        {
+            handles.emplace_back();
+            widths.emplace_back();
+            heights.emplace_back();
+            formats.emplace_back();
+            clippings.emplace_back();
+            channels.emplace_back();
+            descriptions.emplace_back();
+            changes.emplace_back();
+        }
+        slots[i] = nextFree;
+        descriptions[nextFree] = &streams.streams[i];
+        changes[nextFree] = STREAM_ADDED;
+    }
+
+    for (uint32_t i = 0; i < streams.nStreams; ++i)
+    {
+        const StreamDescription& description = streams.streams[i];
+        const uint32_t slot = slots[i];
+        handles[slot] = description.handle;
+        widths[slot] = description.width;
+        heights[slot] = description.height;
+        formats[slot] = description.format;
+        clippings[slot] = description.clipping;
+        channels[slot] = description.channel;
+        m_slotsByHandle.emplace(description.handle, slot);
+    }
 }
 
 CameraData RenderStream::getFrameCamera(StreamHandle stream)
@@ -382,7 +927,7 @@ void RenderStream::setNewStatusMessage(const char* message)
 
 void RenderStream::setLoggingFunction(logger_t func) {
     m_loggingFunc = func;
-    if (!m_rsDll)
+    if (!m_registerLoggingFunc)
     {
         return;
     }
@@ -399,7 +944,7 @@ void RenderStream::setLoggingFunction(logger_t func) {
 
 void RenderStream::setErrorLoggingFunction(logger_t func) {
     m_errorLoggingFunc = func;
-    if (!m_rsDll)
+    if (!m_registerErrorLoggingFunc)
     {
         return;
     }
@@ -416,7 +961,7 @@ void RenderStream::setErrorLoggingFunction(logger_t func) {
 
 void RenderStream::setVerboseLoggingFunction(logger_t func) {
     m_verboseLoggingFunc = func;
-    if (!m_rsDll)
+    if (!m_registerVerboseLoggingFunc)
     {
         return;
     }
@@ -504,81 +1049,225 @@ private:
     }
 };
 
-ParameterValues::ParameterValues(RenderStream& rs, const RemoteParameters& scene)
+SceneParameterState::SceneParameterState(const RemoteParameters& scene)
 {
-    m_rs = &rs;
-    m_parameters = &scene;
-
-    size_t nFloats = 0, nImages = 0, nTexts = 0;
-    for (uint32_t iParam = 0; iParam < m_parameters->nParameters; ++iParam)
+    uint32_t nFloats = 0, nImages = 0, nTexts = 0, nSkeletons = 0, nEvents = 0;
+    for (uint32_t iParam = 0; iParam < scene.nParameters; ++iParam)
     {
-        const RemoteParameter& param = m_parameters->parameters[iParam];
+        const RemoteParameter& param = scene.parameters[iParam];
 
         if (param.flags & REMOTEPARAMETER_READ_ONLY)
             continue;
 
+        const bool sequenced = !(param.flags & REMOTEPARAMETER_NO_SEQUENCE);
+        ParameterSlot slot = { param.type, param.flags, 0, iParam };
+        uint32_t floatCount = 0;
         if (param.type == RS_PARAMETER_NUMBER)
-            nFloats++;
+        {
+            slot.index = nFloats;
+            floatCount = 1;
+        }
         else if (param.type == RS_PARAMETER_IMAGE)
-            nImages++;
+        {
+            slot.index = nImages++;
+            hasSequencedImages |= sequenced;
+        }
         else if (param.type == RS_PARAMETER_POSE)
-            nFloats += 16;
+        {
+            slot.index = nFloats;
+            floatCount = 16;
+        }
         else if (param.type == RS_PARAMETER_TRANSFORM)
-            nFloats += 16;
+        {
+            slot.index = nFloats;
+            floatCount = 16;
+        }
         else if (param.type == RS_PARAMETER_TEXT)
-            nTexts++;
+        {
+            slot.index = nTexts++;
+        }
+        else if (param.type == RS_PARAMETER_SKELETON)
+        {
+            slot.index = nSkeletons++;
+        }
+        else if (param.type == RS_PARAMETER_EVENT)
+        {
+            slot.index = nEvents++;
+        }
         else
+        {
             throw std::logic_error("Unhandled parameter type");
-    }
+        }
 
-    m_floatValues.resize(nFloats);
-    checkRs(rs.m_getFrameParameters(m_parameters->hash, m_floatValues.data(), m_floatValues.size() * sizeof(float)), "get frame float data");
+        if (sequenced && floatCount > 0)
+        {
+            // Merge adjacent sequenced parameters into a single range fetch
+            if (!sequencedFloatRanges.empty() && sequencedFloatRanges.back().first + sequencedFloatRanges.back().second == nFloats)
+                sequencedFloatRanges.back().second += floatCount;
+            else
+                sequencedFloatRanges.emplace_back(nFloats, floatCount);
+        }
+        nFloats += floatCount;
+
+        keys.emplace(param.key, uint32_t(slots.size()));
+        slots.push_back(slot);
+    }
 
-    m_imageValues.resize(nImages);
-    checkRs(m_rs->m_getFrameImageData(m_parameters->hash, m_imageValues.data(), nImages), "get frame image data");
+    floatValues.resize(nFloats);
+    imageValues.resize(nImages);
+    textOffsets.resize(nTexts);
+    textValues.resize(nTexts);
+    textHashes.resize(nTexts);
+    skeletonJoints.resize(nSkeletons);
+    eventCounts.resize(nEvents);
+    floatChanged.resize((nFloats + 63) / 64);
+    changed.resize((slots.size() + 63) / 64);
 }
 
-std::tuple<size_t, RemoteParameterType> ParameterValues::iKey(const std::string& key)
+void SceneParameterState::updateChanged()
 {
-    size_t iFloat = 0, iImage = 0, iText = 0;
-    for (uint32_t iParam = 0; iParam < m_parameters->nParameters; ++iParam)
+    if (first)
     {
-        const RemoteParameter& param = m_parameters->parameters[iParam];
-
-        if (param.flags & REMOTEPARAMETER_READ_ONLY)
-            continue;
+        std::fill(changed.begin(), changed.end(), ~0ull);
+        if (slots.size() % 64)
+            changed.back() = (1ull << (slots.size() % 64)) - 1;
+        // Events are only changed when triggered
+        for (size_t iSlot = 0; iSlot < slots.size(); ++iSlot)
+        {
+            if (slots[iSlot].type == RS_PARAMETER_EVENT && eventCounts[slots[iSlot].index] == 0)
+                changed[iSlot / 64] &= ~(1ull << (iSlot % 64));
+        }
+        first = false;
+        return;
+    }
 
-        if (key == param.key)
+    rsDiffFloats(floatValues.data(), previousFloatValues.data(), floatValues.size(), floatChanged.data());
+    std::fill(changed.begin(), changed.end(), 0ull);
+    for (size_t iSlot = 0; iSlot < slots.size(); ++iSlot)
+    {
+        const ParameterSlot& slot = slots[iSlot];
+        bool dirty = false;
+        if (slot.type == RS_PARAMETER_NUMBER)
         {
-            if (param.type == RS_PARAMETER_NUMBER)
-                return { iFloat, RS_PARAMETER_NUMBER };
-            else if (param.type == RS_PARAMETER_IMAGE)
-                return { iImage, RS_PARAMETER_IMAGE };
-            else if (param.type == RS_PARAMETER_POSE)
-                return { iFloat, RS_PARAMETER_POSE };
-            else if (param.type == RS_PARAMETER_TRANSFORM)
-                return { iFloat, RS_PARAMETER_TRANSFORM };
-            else if (param.type == RS_PARAMETER_TEXT)
-                return { iText, RS_PARAMETER_TEXT };
-            else
-                throw std::logic_error("Unhandled parameter type");
+            dirty = rsAnyBits(floatChanged.data(), slot.index, 1);
+        }
+        else if (slot.type == RS_PARAMETER_POSE || slot.type == RS_PARAMETER_TRANSFORM)
+        {
+            dirty = rsAnyBits(floatChanged.data(), slot.index, 16);
+        }
+        else if (slot.type == RS_PARAMETER_IMAGE)
+        {
+            const ImageFrameData& current = imageValues[slot.index];
+            const ImageFrameData& previous = previousImageValues[slot.index];
+            dirty = current.imageId != previous.imageId || current.width != previous.width || current.height != previous.height || current.format != previous.format;
+        }
+        else if (slot.type == RS_PARAMETER_TEXT)
+        {
+            dirty = textHashes[slot.index] != previousTextHashes[slot.index];
+        }
+        else if (slot.type == RS_PARAMETER_SKELETON)
+        {
+            // Skeleton poses are fetched on demand and are expected to be live (e.g. motion capture)
+            dirty = true;
+        }
+        else if (slot.type == RS_PARAMETER_EVENT)
+        {
+            dirty = eventCounts[slot.index] > 0;
         }
 
-        if (param.type == RS_PARAMETER_NUMBER)
-            iFloat++;
-        else if (param.type == RS_PARAMETER_IMAGE)
-            iImage++;
-        else if (param.type == RS_PARAMETER_POSE)
-            iFloat += 16;
-        else if (param.type == RS_PARAMETER_TRANSFORM)
-            iFloat += 16;
-        else if (param.type == RS_PARAMETER_TEXT)
-            iText++;
-        else
-            throw std::logic_error("Unhandled parameter type");
+        if (dirty)
+            changed[iSlot / 64] |= 1ull << (iSlot % 64);
     }
+}
+
+ParameterValues::ParameterValues(RenderStream& rs, const RemoteParameters& scene)
+{
+    m_rs = &rs;
+    m_parameters = &scene;
+    m_state = &rs.updateParameters(scene);
+}
+
+std::tuple<size_t, RemoteParameterType> ParameterValues::iKey(const std::string& key)
+{
+    auto it = m_state->keys.find(key);
+    if (it == m_state->keys.end())
+        throw std::runtime_error("Unknown key");
+
+    const ParameterSlot& slot = m_state->slots[it->second];
+    return { slot.index, slot.type };
+}
 
-    throw std::runtime_error("Unknown key");
+const float* ParameterValues::matrix(const std::string& key)
+{
+    auto [index, type] = iKey(key);
+    if (type != RS_PARAMETER_TRANSFORM && type != RS_PARAMETER_POSE)
+        throw std::runtime_error("Key is not a transform or pose");
+
+    return &m_state->floatValues[index];
+}
+
+uint32_t ParameterValues::typeIndex(const std::string& key)
+{
+    return uint32_t(std::get<0>(iKey(key)));
+}
+
+size_t ParameterValues::skeletonJointCount(const std::string& key)
+{
+    auto [index, type] = iKey(key);
+    if (type != RS_PARAMETER_SKELETON)
+        throw std::runtime_error("Key is not a skeleton");
+
+    return m_state->skeletonJoints[index].size();
+}
+
+uint32_t ParameterValues::eventCount(const std::string& key)
+{
+    auto [index, type] = iKey(key);
+    if (type != RS_PARAMETER_EVENT)
+        throw std::runtime_error("Key is not an event");
+
+    return m_state->eventCounts[index];
+}
+
+uint64_t ParameterValues::textHash(const std::string& key)
+{
+    auto [index, type] = iKey(key);
+    if (type != RS_PARAMETER_TEXT)
+        throw std::runtime_error("Key is not a text param");
+
+    return m_state->textHashes[index];
+}
+
+bool ParameterValues::changed(const std::string& key)
+{
+    auto it = m_state->keys.find(key);
+    if (it == m_state->keys.end())
+        throw std::runtime_error("Unknown key");
+
+    return (m_state->changed[it->second / 64] >> (it->second % 64)) & 1;
+}
+
+bool ParameterValues::anyChanged() const
+{
+    return std::any_of(m_state->changed.begin(), m_state->changed.end(), [](uint64_t bits) { return bits != 0; });
+}
+
+const std::vector<uint64_t>& ParameterValues::changedMask() const
+{
+    return m_state->changed;
+}
+
+template <typename Fn>
+void ParameterValues::forEachChanged(Fn&& fn) const
+{
+    for (size_t iWord = 0; iWord < m_state->changed.size(); ++iWord)
+    {
+        for (uint64_t bits = m_state->changed[iWord]; bits; bits &= bits - 1)
+        {
+            const ParameterSlot& slot = m_state->slots[iWord * 64 + rsCountTrailingZeros(bits)];
+            fn(m_parameters->parameters[slot.iParameter]);
+        }
+    }
 }
 
 
@@ -594,7 +1283,7 @@ inline float ParameterValues::get(const std::string& key)
     auto [index, type] = iKey(key);
     if (type != RS_PARAMETER_NUMBER)
         throw std::runtime_error("Key is not a number");
-    return m_floatValues[index];
+    return m_state->floatValues[index];
 }
 
 template <>
@@ -604,7 +1293,7 @@ inline std::array<float, 16> ParameterValues::get(const std::string& key)
     if (type != RS_PARAMETER_TRANSFORM && type != RS_PARAMETER_POSE)
         throw std::runtime_error("Key is not a transform or pose");
     std::array<float, 16> out;
-    std::copy(&m_floatValues[index], &m_floatValues[index + 16], out.begin());
+    std::copy(&m_state->floatValues[index], &m_state->floatValues[index + 16], out.begin());
     return out;
 }
 
@@ -615,17 +1304,33 @@ inline ImageFrameData ParameterValues::get(const std::string& key)
     if (type != RS_PARAMETER_IMAGE)
         throw std::runtime_error("Key is not an image");
 
-    return m_imageValues[index];
+    return m_state->imageValues[index];
 }
 
 template <>
-inline const char* ParameterValues::get(const std::string& key)
+inline std::string_view ParameterValues::get(const std::string& key)
 {
     auto [index, type] = iKey(key);
     if (type != RS_PARAMETER_TEXT)
         throw std::runtime_error("Key is not a text param");
 
-    const char* out;
-    checkRs(m_rs->m_getFrameText(m_parameters->hash, uint32_t(index), &out), "getting text parameter");
-    return out;
+    return m_state->textValues[index];
+}
+
+template <>
+inline const char* ParameterValues::get(const std::string& key)
+{
+    // Texts are nul-terminated in the arena
+    return get<std::string_view>(key).data();
 }
+
+template <>
+inline SkeletonPose ParameterValues::get(const std::string& key)
+{
+    auto [index, type] = iKey(key);
+    if (type != RS_PARAMETER_SKELETON)
+        throw std::runtime_error("Key is not a skeleton");
+
+    return m_rs->getSkeletonPose(m_parameters->hash, uint32_t(index), m_state->skeletonJoints[index]);
+}
+
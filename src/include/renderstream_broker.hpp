@@ -0,0 +1,534 @@
+#pragma once
+
+#include "renderstream.hpp"
+#include "renderstream_images.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// Fans the frame requests, parameters and image parameters of one RenderStream process out to the other engine
+// processes on the same machine, e.g. one process per GPU, so that the dll transfers and converts them once rather than
+// once per process. The broker process awaits each frame, fetches the parameters and images of its scene and publishes
+// them into a ring of seqlocked slots in shared memory. Clients read them in place, and begin the frame as followers.
+//
+// Broker:
+//     ParameterBroker broker(rs, *schema, "Local\\MyEngineParameters");
+//     auto result = broker.awaitFrame(5000);  // in place of awaitFrameData, handled the same way
+//     ... render this process's streams using broker.parameters() ...
+//
+// Client:
+//     ParameterBrokerClient client(rs, "Local\\MyEngineParameters");
+//     auto result = client.awaitFrame(5000);  // in place of awaitFrameData, handled the same way
+//     const BrokerFrame& frame = client.frame();
+//     ... read frame.floats(), frame.image(i) ...
+//     if (!frame.valid()) ... the broker has overwritten the slot, so what was read may be torn ...
+class ParameterBroker;
+
+namespace rs_detail
+{
+    const uint32_t BROKER_MAGIC = 0x42535244; // "DRSB"
+    const uint32_t BROKER_VERSION = 2;
+    const size_t BROKER_ALIGNMENT = 64;
+
+    inline size_t alignBroker(size_t offset) { return (offset + BROKER_ALIGNMENT - 1) & ~(BROKER_ALIGNMENT - 1); }
+
+    struct BrokerHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t nSlots;
+        uint64_t slotStride; // bytes from one slot to the next
+        std::atomic<uint64_t> generation; // incremented each time a broker starts on the mapping, restarting published
+        alignas(64) std::atomic<uint64_t> published; // frames published; the latest is in slot (published - 1) % nSlots
+    };
+
+    // Followed by the payload: floats, cameras, images, then the pixels of each image, each aligned to BROKER_ALIGNMENT
+    struct BrokerSlot
+    {
+        alignas(64) std::atomic<uint64_t> sequence; // odd while the broker is writing
+        uint64_t frameNumber;
+        RS_ERROR status; // RS_ERROR_SUCCESS, or RS_ERROR_QUIT for the last frame
+        FrameData frame;
+        uint64_t sceneHash;
+        uint32_t nFloats;
+        uint32_t nCameras;
+        uint32_t nImages;
+        uint64_t camerasOffset;
+        uint64_t imagesOffset;
+    };
+
+    struct BrokerCamera
+    {
+        StreamHandle stream;
+        CameraData camera;
+    };
+
+    struct BrokerImage
+    {
+        int64_t imageId;
+        uint32_t width;
+        uint32_t height;
+        RSPixelFormat format;
+        uint32_t stride;
+        uint64_t offset; // of the pixels, from the start of the payload
+    };
+
+    // A named mapping of (size) bytes, created by the broker and opened by clients
+    class SharedMapping
+    {
+    public:
+        SharedMapping() = default;
+        inline ~SharedMapping();
+        SharedMapping(const SharedMapping&) = delete;
+        SharedMapping& operator=(const SharedMapping&) = delete;
+
+        // Both release any mapping already held first. create returns false if the mapping already existed, e.g. kept
+        // open by the clients of a broker that exited, and throws if it is smaller than (size).
+        inline bool create(const char* name, uint64_t size);
+        inline bool open(const char* name);
+        inline void close();
+
+        uint8_t* data() const { return m_view; }
+
+    private:
+        HANDLE m_mapping = nullptr;
+        uint8_t* m_view = nullptr;
+    };
+
+    SharedMapping::~SharedMapping()
+    {
+        close();
+    }
+
+    void SharedMapping::close()
+    {
+        if (m_view)
+            UnmapViewOfFile(m_view);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        m_view = nullptr;
+        m_mapping = nullptr;
+    }
+
+    bool SharedMapping::create(const char* name, uint64_t size)
+    {
+        close();
+        m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, DWORD(size >> 32), DWORD(size), name);
+        if (!m_mapping)
+            throw std::runtime_error(std::string("Failed to create shared memory '") + name + "'");
+        const bool existed = GetLastError() == ERROR_ALREADY_EXISTS;
+        m_view = static_cast<uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+        if (!m_view)
+            throw std::runtime_error(std::string("Failed to map shared memory '") + name + "'");
+
+        // An existing section keeps the size it was created with, and the view covers all of it
+        MEMORY_BASIC_INFORMATION info = {};
+        if (existed && (!VirtualQuery(m_view, &info, sizeof(info)) || info.RegionSize < size))
+        {
+            close();
+            throw std::runtime_error(std::string("Shared memory '") + name + "' already exists with a different size");
+        }
+        return !existed;
+    }
+
+    bool SharedMapping::open(const char* name)
+    {
+        close();
+        m_mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+        if (!m_mapping)
+            return false;
+        m_view = static_cast<uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+        if (!m_view)
+        {
+            CloseHandle(m_mapping);
+            m_mapping = nullptr;
+            return false;
+        }
+        return true;
+    }
+}
+
+// A frame published by the broker, read in place from shared memory. The broker overwrites the slot (nSlots - 1) frames
+// later; valid() tells whether it has started to, after which anything read from the frame may be torn.
+class BrokerFrame
+{
+public:
+    const FrameData& frame() const { return m_frame; }
+    uint64_t frameNumber() const { return m_frameNumber; }
+    // Of the scene the parameters belong to, the RemoteParameters::hash of schema->scenes.scenes[frame().scene]
+    uint64_t sceneHash() const { return m_sceneHash; }
+
+    // The whole float block of the scene, in schema order, as ParameterValues::floats
+    const float* floats() const { return reinterpret_cast<const float*>(m_payload); }
+    size_t floatCount() const { return m_nFloats; }
+
+    // The image parameters of the scene, in schema order
+    size_t imageCount() const { return m_nImages; }
+    inline HostImage image(size_t index) const;
+
+    // The camera of one of the broker process's streams, or nullptr
+    inline const CameraData* camera(StreamHandle stream) const;
+
+    bool valid() const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return m_slot && m_slot->sequence.load(std::memory_order_relaxed) == m_sequence;
+    }
+
+private:
+    friend class ParameterBrokerClient;
+
+    const rs_detail::BrokerSlot* m_slot = nullptr;
+    const uint8_t* m_payload = nullptr;
+    uint64_t m_sequence = 0;
+    uint64_t m_frameNumber = 0;
+    FrameData m_frame = {};
+    uint64_t m_sceneHash = 0;
+    uint32_t m_nFloats = 0;
+    uint32_t m_nCameras = 0;
+    uint32_t m_nImages = 0;
+    const rs_detail::BrokerCamera* m_cameras = nullptr;
+    const rs_detail::BrokerImage* m_images = nullptr;
+};
+
+// Awaits frames for every engine process on the machine, see above.
+class ParameterBroker
+{
+public:
+    static const uint32_t DEFAULT_SLOTS = 3;
+    static const size_t DEFAULT_SLOT_CAPACITY = 64 * 1024 * 1024; // floats, cameras and images of one frame
+
+    // Creates the named shared memory. (schema) must outlive the broker.
+    inline ParameterBroker(RenderStream& rs, const Schema& schema, const char* name, uint32_t nSlots = DEFAULT_SLOTS, size_t slotCapacity = DEFAULT_SLOT_CAPACITY);
+    ParameterBroker(const ParameterBroker&) = delete;
+    ParameterBroker& operator=(const ParameterBroker&) = delete;
+
+    // Returns the same as rs.awaitFrameData. Frames are published before returning, and RS_ERROR_QUIT is published to
+    // clients too.
+    inline std::variant<FrameData, RS_ERROR> awaitFrame(int timeoutMs);
+
+    // Of the frame last returned by awaitFrame, for rendering the broker process's own streams
+    ParameterValues& parameters() { return *m_values; }
+    ImageParameterCache& images() { return m_images; }
+
+private:
+    inline void publish(RS_ERROR status, const FrameData& frame, const RemoteParameters* scene);
+
+    RenderStream* m_rs;
+    const Schema* m_schema;
+    uint32_t m_nSlots;
+    size_t m_slotCapacity;
+    rs_detail::SharedMapping m_mapping;
+    rs_detail::BrokerHeader* m_header = nullptr;
+    ImageParameterCache m_images;
+    std::unique_ptr<ParameterValues> m_values;
+    std::vector<HostImage> m_frameImages;
+    std::vector<std::vector<rs_detail::BrokerImage>> m_slotImages; // as last written to each slot
+};
+
+// Reads frames published by a ParameterBroker on the same machine, and begins them with rs_beginFollowerFrame.
+class ParameterBrokerClient
+{
+public:
+    struct Stats
+    {
+        uint64_t frames = 0;
+        uint64_t skipped = 0; // published while this client was busy, and never seen
+    };
+
+    // Marks this process as a follower. The broker does not need to be running yet.
+    inline ParameterBrokerClient(RenderStream& rs, const char* name);
+    ParameterBrokerClient(const ParameterBrokerClient&) = delete;
+    ParameterBrokerClient& operator=(const ParameterBrokerClient&) = delete;
+
+    // Blocks until the broker publishes a newer frame, then begins it. Returns RS_ERROR_TIMEOUT if none was published
+    // within (timeoutMs), RS_ERROR_QUIT when the broker quits, or any error from rs_beginFollowerFrame. After
+    // RS_ERROR_STREAMS_CHANGED, update the streams and call again: the same frame is begun again.
+    inline std::variant<FrameData, RS_ERROR> awaitFrame(int timeoutMs);
+
+    // The frame last returned by awaitFrame
+    const BrokerFrame& frame() const { return m_frame; }
+    const Stats& stats() const { return m_stats; }
+
+private:
+    inline bool open();
+    inline bool read();
+
+    RenderStream* m_rs;
+    std::string m_name;
+    rs_detail::SharedMapping m_mapping;
+    const rs_detail::BrokerHeader* m_header = nullptr;
+    uint64_t m_generation = 0; // of the broker m_frame came from
+    BrokerFrame m_frame;
+    RS_ERROR m_status = RS_ERROR_SUCCESS;
+    bool m_pending = false; // m_frame was read but not yet begun
+    Stats m_stats;
+};
+
+HostImage BrokerFrame::image(size_t index) const
+{
+    const rs_detail::BrokerImage& image = m_images[index];
+    HostImage out;
+    out.imageId = image.imageId;
+    out.width = image.width;
+    out.height = image.height;
+    out.format = image.format;
+    out.stride = image.stride;
+    out.data = m_payload + image.offset;
+    return out;
+}
+
+const CameraData* BrokerFrame::camera(StreamHandle stream) const
+{
+    for (uint32_t i = 0; i < m_nCameras; ++i)
+    {
+        if (m_cameras[i].stream == stream)
+            return &m_cameras[i].camera;
+    }
+    return nullptr;
+}
+
+ParameterBroker::ParameterBroker(RenderStream& rs, const Schema& schema, const char* name, uint32_t nSlots, size_t slotCapacity)
+    : m_rs(&rs), m_schema(&schema), m_nSlots(std::max(nSlots, 2u)), m_slotCapacity(slotCapacity), m_images(rs), m_slotImages(m_nSlots)
+{
+    const uint64_t slotStride = rs_detail::alignBroker(sizeof(rs_detail::BrokerSlot) + slotCapacity);
+    if (!m_mapping.create(name, rs_detail::alignBroker(sizeof(rs_detail::BrokerHeader)) + slotStride * m_nSlots))
+    {
+        // Left by a broker that exited while clients kept it open. They may still be reading it, so only a mapping of
+        // the same layout is taken over: the slots keep their sequences, and the new generation tells the clients that
+        // frame numbers restart.
+        m_header = reinterpret_cast<rs_detail::BrokerHeader*>(m_mapping.data());
+        if (m_header->magic == rs_detail::BROKER_MAGIC)
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (m_header->version != rs_detail::BROKER_VERSION || m_header->nSlots != m_nSlots || m_header->slotStride != slotStride)
+                throw std::runtime_error(std::string("Parameter broker '") + name + "' already exists with a different version or layout");
+            m_header->published.store(0, std::memory_order_relaxed);
+            for (uint32_t i = 0; i < m_nSlots; ++i)
+            {
+                // Completes any write the previous broker was killed during, so the slot reads as torn rather than busy
+                uint8_t* slotMemory = m_mapping.data() + rs_detail::alignBroker(sizeof(rs_detail::BrokerHeader)) + i * slotStride;
+                std::atomic<uint64_t>& sequence = reinterpret_cast<rs_detail::BrokerSlot*>(slotMemory)->sequence;
+                if (sequence.load(std::memory_order_relaxed) % 2 != 0)
+                    sequence.fetch_add(1, std::memory_order_relaxed);
+            }
+            m_header->generation.fetch_add(1, std::memory_order_release);
+            return;
+        }
+    }
+
+    // Sequences start at 0 in the zeroed mapping; the header is written last so clients ignore it until it is complete
+    m_header = new (m_mapping.data()) rs_detail::BrokerHeader();
+    m_header->nSlots = m_nSlots;
+    m_header->slotStride = slotStride;
+    m_header->version = rs_detail::BROKER_VERSION;
+    m_header->generation.store(1, std::memory_order_relaxed);
+    m_header->published.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->magic = rs_detail::BROKER_MAGIC;
+}
+
+std::variant<FrameData, RS_ERROR> ParameterBroker::awaitFrame(int timeoutMs)
+{
+    auto result = m_rs->awaitFrameData(timeoutMs);
+    if (std::holds_alternative<RS_ERROR>(result))
+    {
+        if (std::get<RS_ERROR>(result) == RS_ERROR_QUIT)
+            publish(RS_ERROR_QUIT, FrameData{}, nullptr);
+        return result;
+    }
+
+    const FrameData& frame = std::get<FrameData>(result);
+    const RemoteParameters* scene = frame.scene < m_schema->scenes.nScenes ? &m_schema->scenes.scenes[frame.scene] : nullptr;
+    publish(RS_ERROR_SUCCESS, frame, scene);
+    return result;
+}
+
+void ParameterBroker::publish(RS_ERROR status, const FrameData& frame, const RemoteParameters* scene)
+{
+    // Fetch everything before taking the slot, so it is unreadable for as short a time as possible
+    m_frameImages.clear();
+    const float* floats = nullptr;
+    size_t nFloats = 0;
+    if (scene)
+    {
+        m_values = std::make_unique<ParameterValues>(m_rs->getFrameParameters(*scene));
+        floats = m_values->floats().data();
+        nFloats = m_values->floats().size();
+        for (uint32_t i = 0; i < scene->nParameters; ++i)
+        {
+            const RemoteParameter& parameter = scene->parameters[i];
+            if (parameter.type == RS_PARAMETER_IMAGE && !(parameter.flags & REMOTEPARAMETER_READ_ONLY))
+                m_frameImages.push_back(m_images.get(*m_values, parameter.key));
+        }
+    }
+
+    std::vector<rs_detail::BrokerCamera> cameras;
+    const StreamTable& streams = m_rs->streams();
+    for (uint32_t slot = 0; status == RS_ERROR_SUCCESS && slot < streams.capacity(); ++slot)
+    {
+        if (!streams.used(slot))
+            continue;
+        try
+        {
+            cameras.push_back({ streams.handles[slot], m_rs->getFrameCamera(streams.handles[slot]) });
+        }
+        catch (const RenderStreamError& e)
+        {
+            if (e.error != RS_ERROR_NOTFOUND)
+                throw;
+        }
+    }
+
+    // Lay out the payload
+    const size_t camerasOffset = rs_detail::alignBroker(nFloats * sizeof(float));
+    const size_t imagesOffset = rs_detail::alignBroker(camerasOffset + cameras.size() * sizeof(rs_detail::BrokerCamera));
+    size_t size = rs_detail::alignBroker(imagesOffset + m_frameImages.size() * sizeof(rs_detail::BrokerImage));
+    std::vector<rs_detail::BrokerImage> images;
+    for (const HostImage& image : m_frameImages)
+    {
+        images.push_back({ image.imageId, image.width, image.height, image.format, image.stride, size });
+        size = rs_detail::alignBroker(size + size_t(image.stride) * image.height);
+    }
+    if (size > m_slotCapacity)
+        throw std::runtime_error("Frame of " + std::to_string(size) + " bytes does not fit a parameter broker slot of " + std::to_string(m_slotCapacity));
+
+    const uint64_t frameNumber = m_header->published.load(std::memory_order_relaxed) + 1;
+    const uint32_t iSlot = uint32_t((frameNumber - 1) % m_nSlots);
+    uint8_t* slotMemory = m_mapping.data() + rs_detail::alignBroker(sizeof(rs_detail::BrokerHeader)) + iSlot * m_header->slotStride;
+    rs_detail::BrokerSlot* slot = reinterpret_cast<rs_detail::BrokerSlot*>(slotMemory);
+    uint8_t* payload = slotMemory + rs_detail::alignBroker(sizeof(rs_detail::BrokerSlot));
+
+    const uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->frameNumber = frameNumber;
+    slot->status = status;
+    slot->frame = frame;
+    slot->sceneHash = scene ? scene->hash : 0;
+    slot->nFloats = uint32_t(nFloats);
+    slot->nCameras = uint32_t(cameras.size());
+    slot->nImages = uint32_t(images.size());
+    slot->camerasOffset = camerasOffset;
+    slot->imagesOffset = imagesOffset;
+    if (nFloats > 0)
+        memcpy(payload, floats, nFloats * sizeof(float));
+    if (!cameras.empty())
+        memcpy(payload + camerasOffset, cameras.data(), cameras.size() * sizeof(rs_detail::BrokerCamera));
+    if (!images.empty())
+        memcpy(payload + imagesOffset, images.data(), images.size() * sizeof(rs_detail::BrokerImage));
+
+    // Images rarely change, so skip those this slot already holds in the same place
+    std::vector<rs_detail::BrokerImage>& previous = m_slotImages[iSlot];
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        const rs_detail::BrokerImage& image = images[i];
+        if (i < previous.size() && previous[i].imageId == image.imageId && previous[i].offset == image.offset)
+            continue;
+        memcpy(payload + image.offset, m_frameImages[i].data, size_t(image.stride) * image.height);
+    }
+    previous = images;
+
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+    m_header->published.store(frameNumber, std::memory_order_release);
+}
+
+ParameterBrokerClient::ParameterBrokerClient(RenderStream& rs, const char* name)
+    : m_rs(&rs), m_name(name)
+{
+    m_rs->setFollower(true);
+}
+
+bool ParameterBrokerClient::open()
+{
+    if (!m_mapping.open(m_name.c_str()))
+        return false;
+    const rs_detail::BrokerHeader* header = reinterpret_cast<const rs_detail::BrokerHeader*>(m_mapping.data());
+    if (header->magic != rs_detail::BROKER_MAGIC)
+    {
+        m_mapping.close(); // still being created, opened again on the next call
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header->version != rs_detail::BROKER_VERSION)
+        throw std::runtime_error("Parameter broker '" + m_name + "' is version " + std::to_string(header->version) + ", expected " + std::to_string(rs_detail::BROKER_VERSION));
+    m_header = header;
+    return true;
+}
+
+// Reads the latest published frame, if it is newer than m_frame
+bool ParameterBrokerClient::read()
+{
+    const uint64_t generation = m_header->generation.load(std::memory_order_acquire);
+    if (generation != m_generation)
+    {
+        // The broker restarted, and numbers its frames from 1 again
+        m_generation = generation;
+        m_frame = BrokerFrame();
+    }
+    const uint64_t published = m_header->published.load(std::memory_order_acquire);
+    if (published <= m_frame.m_frameNumber)
+        return false;
+
+    const uint8_t* slotMemory = m_mapping.data() + rs_detail::alignBroker(sizeof(rs_detail::BrokerHeader)) + ((published - 1) % m_header->nSlots) * m_header->slotStride;
+    const rs_detail::BrokerSlot* slot = reinterpret_cast<const rs_detail::BrokerSlot*>(slotMemory);
+    const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    if (sequence % 2 != 0)
+        return false; // being overwritten by a newer frame, which is read next time
+
+    BrokerFrame frame;
+    frame.m_slot = slot;
+    frame.m_payload = slotMemory + rs_detail::alignBroker(sizeof(rs_detail::BrokerSlot));
+    frame.m_sequence = sequence;
+    frame.m_frameNumber = slot->frameNumber;
+    frame.m_frame = slot->frame;
+    frame.m_sceneHash = slot->sceneHash;
+    frame.m_nFloats = slot->nFloats;
+    frame.m_nCameras = slot->nCameras;
+    frame.m_nImages = slot->nImages;
+    frame.m_cameras = reinterpret_cast<const rs_detail::BrokerCamera*>(frame.m_payload + slot->camerasOffset);
+    frame.m_images = reinterpret_cast<const rs_detail::BrokerImage*>(frame.m_payload + slot->imagesOffset);
+    const RS_ERROR status = slot->status;
+    if (!frame.valid() || m_header->generation.load(std::memory_order_relaxed) != generation)
+        return false;
+
+    if (m_frame.m_frameNumber != 0 && frame.m_frameNumber > m_frame.m_frameNumber + 1)
+        m_stats.skipped += frame.m_frameNumber - m_frame.m_frameNumber - 1;
+    m_frame = frame;
+    m_status = status;
+    ++m_stats.frames;
+    return true;
+}
+
+std::variant<FrameData, RS_ERROR> ParameterBrokerClient::awaitFrame(int timeoutMs)
+{
+    if (!m_pending)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        for (uint32_t spin = 0;; ++spin)
+        {
+            if ((m_header || open()) && read())
+                break;
+            if (std::chrono::steady_clock::now() >= deadline)
+                return RS_ERROR_TIMEOUT;
+            // Spin briefly for latency, then stop burning the core
+            if (spin < 1000)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        if (m_status != RS_ERROR_SUCCESS)
+            return m_status;
+        m_pending = true;
+    }
+
+    RS_ERROR err = m_rs->beginFollowerFrame(m_frame.frame().tTracked);
+    if (err == RS_ERROR_STREAMS_CHANGED)
+        return err; // still pending, begun again on the next call
+    m_pending = false;
+    if (err != RS_ERROR_SUCCESS)
+        return err;
+    return m_frame.frame();
+}
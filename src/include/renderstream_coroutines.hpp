@@ -0,0 +1,400 @@
+#pragma once
+
+// C++20 coroutine frame loop. Empty when compiled as an earlier standard, so it can be included unconditionally.
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#include "renderstream.hpp"
+#include "renderstream_images.hpp"
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <optional>
+#include <utility>
+
+// Runs the frame loop and any other work, such as asset streaming, as coroutines on one thread. A coroutine waiting for a
+// frame, a stream change or an image parameter lets the others run, and frame work is resumed ahead of background work
+// as soon as a frame arrives. Background coroutines should co_await yield() between chunks of work so that frames are
+// not held up; awaitFrameData is only polled without blocking while any of them are ready to run.
+//
+//     FrameLoop loop(rs);
+//     loop.spawn(streamAssets(loop));  // Task<void> streamAssets(FrameLoop& loop) { ... co_await loop.yield(); ... }
+//     loop.run([&]() -> Task<void> {
+//         while (std::optional<FrameData> frame = co_await loop.nextFrame())  // std::nullopt on RS_ERROR_QUIT
+//         {
+//             ParameterValues values = rs.getFrameParameters(scene);
+//             const HostImage& image = co_await loop.image(values, "texture");
+//             ... render and sendFrame ...
+//         }
+//     }());
+//
+// Stream changes are handled by the loop, which calls rs.getStreams() and resumes any coroutine awaiting streamsChanged().
+// awaitFrameData is only called while a coroutine awaits nextFrame(), so streamsChanged() resolves on the way to the
+// next frame. samples/Coroutines is a complete application, built as C++20.
+template <typename T>
+class Task;
+
+namespace rs_detail
+{
+    template <typename T>
+    struct TaskPromiseBase
+    {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr exception;
+
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+            template <typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept
+            {
+                std::coroutine_handle<> continuation = h.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    template <typename T>
+    struct TaskPromise : TaskPromiseBase<T>
+    {
+        std::optional<T> value;
+
+        Task<T> get_return_object();
+        template <typename U>
+        void return_value(U&& v) { value.emplace(std::forward<U>(v)); }
+        T result()
+        {
+            if (this->exception)
+                std::rethrow_exception(this->exception);
+            return std::move(*value);
+        }
+    };
+
+    template <>
+    struct TaskPromise<void> : TaskPromiseBase<void>
+    {
+        inline Task<void> get_return_object();
+        void return_void() {}
+        void result()
+        {
+            if (exception)
+                std::rethrow_exception(exception);
+        }
+    };
+}
+
+// A lazily started coroutine, which runs when awaited or when given to FrameLoop::spawn or run
+template <typename T = void>
+class Task
+{
+public:
+    using promise_type = rs_detail::TaskPromise<T>;
+
+    Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+    Task& operator=(Task&& other) noexcept
+    {
+        if (m_handle)
+            m_handle.destroy();
+        m_handle = std::exchange(other.m_handle, {});
+        return *this;
+    }
+    ~Task()
+    {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    bool done() const { return !m_handle || m_handle.done(); }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        m_handle.promise().continuation = awaiting;
+        return m_handle;
+    }
+    T await_resume() { return m_handle.promise().result(); }
+
+private:
+    friend class FrameLoop;
+    friend struct rs_detail::TaskPromise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+namespace rs_detail
+{
+    template <typename T>
+    Task<T> TaskPromise<T>::get_return_object()
+    {
+        return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+    }
+
+    Task<void> TaskPromise<void>::get_return_object()
+    {
+        return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+    }
+}
+
+// Single-threaded executor for Tasks, driven by awaitFrameData. See above.
+class FrameLoop
+{
+public:
+    static const int DEFAULT_TIMEOUT_MS = 5000;
+
+    inline explicit FrameLoop(RenderStream& rs, int timeoutMs = DEFAULT_TIMEOUT_MS);
+    FrameLoop(const FrameLoop&) = delete;
+    FrameLoop& operator=(const FrameLoop&) = delete;
+
+    // Runs (task) and everything it spawns until (task) completes, then rethrows anything it threw. Spawned tasks which
+    // have not completed by then are destroyed.
+    inline void run(Task<void> task);
+    // Starts (task) alongside the others. Anything it throws is rethrown from run.
+    inline void spawn(Task<void> task);
+
+    // The next frame requested by d3, or std::nullopt once d3 asks the application to quit. Throws RenderStreamError for
+    // any other error. Every coroutine waiting when a frame arrives receives the same frame.
+    auto nextFrame() { return FrameAwaiter{ this, std::nullopt, nullptr }; }
+    // Resumes after the loop has handled the next RS_ERROR_STREAMS_CHANGED with the new streams, or with nullptr once
+    // nextFrame has failed. Only seen while another coroutine awaits nextFrame().
+    auto streamsChanged() { return StreamsAwaiter{ this }; }
+    // The image parameter (key) of (values), fetched to host memory by the loop once the ready coroutines have run
+    auto image(ParameterValues& values, const std::string& key) { return ImageAwaiter{ this, values.scene().hash, key, values.get<ImageFrameData>(key), nullptr, nullptr }; }
+    // Lets the other ready coroutines and any frame that has arrived run first
+    auto yield() { return YieldAwaiter{ this }; }
+
+    ImageParameterCache& images() { return m_images; }
+
+private:
+    struct FrameAwaiter
+    {
+        FrameLoop* loop;
+        std::optional<FrameData> frame;
+        std::exception_ptr error;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) { loop->m_frameWaiters.push_back({ h, this }); }
+        std::optional<FrameData> await_resume()
+        {
+            if (error)
+                std::rethrow_exception(error);
+            return frame;
+        }
+    };
+
+    struct StreamsAwaiter
+    {
+        FrameLoop* loop;
+        const StreamDescriptions* streams = nullptr;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) { loop->m_streamsWaiters.push_back({ h, this }); }
+        const StreamDescriptions* await_resume() const { return streams; }
+    };
+
+    struct ImageAwaiter
+    {
+        FrameLoop* loop;
+        uint64_t schemaHash;
+        std::string key;
+        ImageFrameData data;
+        const HostImage* image = nullptr;
+        std::exception_ptr error;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) { loop->m_imageWaiters.push_back({ h, this }); }
+        const HostImage& await_resume()
+        {
+            if (error)
+                std::rethrow_exception(error);
+            return *image;
+        }
+    };
+
+    struct YieldAwaiter
+    {
+        FrameLoop* loop;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) { loop->m_ready.push_back(h); }
+        void await_resume() const noexcept {}
+    };
+
+    template <typename Awaiter>
+    struct Waiter
+    {
+        std::coroutine_handle<> handle;
+        Awaiter* awaiter;
+    };
+
+    inline void runReady();
+    inline void fetchImages();
+    inline void pollFrame(int timeoutMs);
+    inline void collectSpawned();
+    inline void reset();
+
+    RenderStream* m_rs;
+    int m_timeoutMs;
+    ImageParameterCache m_images;
+    std::deque<std::coroutine_handle<>> m_ready;
+    std::vector<Waiter<FrameAwaiter>> m_frameWaiters;
+    std::vector<Waiter<StreamsAwaiter>> m_streamsWaiters;
+    std::vector<Waiter<ImageAwaiter>> m_imageWaiters;
+    std::vector<Task<void>> m_spawned;
+};
+
+FrameLoop::FrameLoop(RenderStream& rs, int timeoutMs)
+    : m_rs(&rs), m_timeoutMs(timeoutMs), m_images(rs)
+{
+}
+
+void FrameLoop::spawn(Task<void> task)
+{
+    m_ready.push_back(task.m_handle);
+    m_spawned.push_back(std::move(task));
+}
+
+void FrameLoop::run(Task<void> task)
+{
+    m_ready.push_back(task.m_handle);
+    try
+    {
+        while (!task.done())
+        {
+            runReady();
+            collectSpawned();
+            if (task.done())
+                break;
+            fetchImages();
+            // Only between frames: polling while frame work is suspended mid-frame would drop a frame, or rebuild the
+            // streams it is iterating
+            if (m_frameWaiters.empty())
+            {
+                if (m_ready.empty() && m_imageWaiters.empty())
+                    throw std::runtime_error("Frame loop deadlocked: every task is waiting on something other than the loop");
+            }
+            else if (!m_ready.empty())
+            {
+                // Background work is waiting, so only take a frame if one is already here
+                pollFrame(0);
+            }
+            else
+            {
+                pollFrame(m_timeoutMs);
+            }
+        }
+    }
+    catch (...)
+    {
+        // (task) is destroyed as this unwinds, so nothing may be left to resume it on a later run
+        reset();
+        throw;
+    }
+
+    reset();
+    task.m_handle.promise().result();
+}
+
+void FrameLoop::reset()
+{
+    m_ready.clear();
+    m_frameWaiters.clear();
+    m_streamsWaiters.clear();
+    m_imageWaiters.clear();
+    m_spawned.clear();
+}
+
+void FrameLoop::runReady()
+{
+    // Only what is ready now, so that a coroutine yielding in a loop cannot starve awaitFrameData
+    for (size_t n = m_ready.size(); n > 0 && !m_ready.empty(); --n)
+    {
+        std::coroutine_handle<> h = m_ready.front();
+        m_ready.pop_front();
+        h.resume();
+    }
+}
+
+void FrameLoop::collectSpawned()
+{
+    for (size_t i = 0; i < m_spawned.size();)
+    {
+        if (!m_spawned[i].done())
+        {
+            ++i;
+            continue;
+        }
+        Task<void> task = std::move(m_spawned[i]);
+        m_spawned.erase(m_spawned.begin() + i);
+        task.m_handle.promise().result();
+    }
+}
+
+void FrameLoop::fetchImages()
+{
+    std::vector<Waiter<ImageAwaiter>> waiters;
+    waiters.swap(m_imageWaiters);
+    for (const Waiter<ImageAwaiter>& waiter : waiters)
+    {
+        try
+        {
+            waiter.awaiter->image = &m_images.get(waiter.awaiter->schemaHash, waiter.awaiter->key, waiter.awaiter->data);
+        }
+        catch (...)
+        {
+            waiter.awaiter->error = std::current_exception();
+        }
+        m_ready.push_back(waiter.handle);
+    }
+}
+
+void FrameLoop::pollFrame(int timeoutMs)
+{
+    auto result = m_rs->awaitFrameData(timeoutMs);
+    if (std::holds_alternative<FrameData>(result))
+    {
+        // Frame work goes ahead of background work, in the order it started waiting
+        for (auto it = m_frameWaiters.rbegin(); it != m_frameWaiters.rend(); ++it)
+        {
+            it->awaiter->frame = std::get<FrameData>(result);
+            m_ready.push_front(it->handle);
+        }
+        m_frameWaiters.clear();
+        return;
+    }
+
+    const RS_ERROR err = std::get<RS_ERROR>(result);
+    if (err == RS_ERROR_TIMEOUT)
+        return;
+    if (err == RS_ERROR_STREAMS_CHANGED)
+    {
+        const StreamDescriptions* streams = m_rs->getStreams();
+        for (auto it = m_streamsWaiters.rbegin(); it != m_streamsWaiters.rend(); ++it)
+        {
+            it->awaiter->streams = streams;
+            m_ready.push_front(it->handle);
+        }
+        m_streamsWaiters.clear();
+        return;
+    }
+
+    // RS_ERROR_QUIT resumes frame waiters with no frame, anything else with the error
+    const std::exception_ptr error = err == RS_ERROR_QUIT ? nullptr : std::make_exception_ptr(RenderStreamError(err, "Error calling awaitFrameData - " + std::to_string(err)));
+    for (const Waiter<FrameAwaiter>& waiter : m_frameWaiters)
+    {
+        waiter.awaiter->error = error;
+        m_ready.push_back(waiter.handle);
+    }
+    m_frameWaiters.clear();
+    for (const Waiter<StreamsAwaiter>& waiter : m_streamsWaiters)
+        m_ready.push_back(waiter.handle);
+    m_streamsWaiters.clear();
+}
+
+#endif
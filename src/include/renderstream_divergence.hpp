@@ -0,0 +1,350 @@
+#pragma once
+
+#include "renderstream_followers.hpp"
+
+#include <functional>
+#include <map>
+
+// Detects nodes of a cluster rendering different pixels for the same frame, which otherwise only shows up as visible tearing.
+// Each node hashes the host memory frames it sends, or just the regions of its canvas which overlap another node's, keyed by
+// tTracked and an application-chosen key. Nodes multicast their hashes to each other, and every node reports any hash which
+// differs from another node's for the same key and frame as soon as both have arrived.
+//
+// Every node:
+//     DivergenceDetector divergence(nodeIndex, "239.0.0.2", 7001);
+//     divergence.setSampleInterval(10);  // hash one frame in 10, to keep the cost down
+//     divergence.onDivergence([](const DivergenceDetector::Divergence& d) { ... });  // RS_LOGs by default
+//     ...
+//     divergence.hashFrame(frameData.tTracked, description, frame);  // only meaningful for streams rendered by several nodes
+//     divergence.hashRegion(frameData.tTracked, EDGE_BLEND_LEFT, frame, 0, 0, 128, description.height);
+//     rs.sendFrame(description.handle, frame, response);
+//     ...
+//     divergence.exchange();  // once per frame
+class DivergenceDetector
+{
+public:
+    static const uint32_t DEFAULT_SAMPLE_INTERVAL = 1;
+    static const size_t DEFAULT_HISTORY = 4096; // hashes remembered, across all keys and frames
+
+    struct Divergence
+    {
+        double tTracked;
+        uint64_t key;
+        uint32_t firstNode; // whose hash arrived first
+        uint64_t firstHash;
+        uint32_t node;
+        uint64_t hash;
+    };
+
+    struct Stats
+    {
+        uint64_t hashed = 0; // frames and regions
+        uint64_t bytesHashed = 0;
+        double hashSeconds = 0;
+        uint64_t received = 0; // hashes from other nodes
+        uint64_t matched = 0;
+        uint64_t diverged = 0;
+    };
+
+    // Joins the multicast (group) on (port), shared by every node of the cluster. (node) identifies this node in reports.
+    inline DivergenceDetector(uint32_t node, const char* group, uint16_t port, int ttl = 1, size_t history = DEFAULT_HISTORY);
+    inline ~DivergenceDetector();
+    DivergenceDetector(const DivergenceDetector&) = delete;
+    DivergenceDetector& operator=(const DivergenceDetector&) = delete;
+
+    // Only frames whose tTracked falls in 1 of every (interval) are hashed. The same frames are chosen on every node.
+    void setSampleInterval(uint32_t interval) { m_sampleInterval = std::max(interval, 1u); }
+    inline bool sampled(double tTracked) const;
+
+    // Hashes a host memory frame of (description), keyed by the stream name. Other frame types are ignored.
+    inline void hashFrame(double tTracked, const StreamDescription& description, const SenderFrame& frame);
+    // Hashes the pixels of a host memory frame from (x, y), (width) by (height), under (key)
+    inline void hashRegion(double tTracked, uint64_t key, const SenderFrame& frame, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+    // Sends the hashes computed since the last call, and compares the hashes received from other nodes. Does not block.
+    inline void exchange();
+
+    void onDivergence(std::function<void(const Divergence&)> fn) { m_onDivergence = std::move(fn); }
+    Stats stats() const { return m_stats; }
+
+private:
+    struct Record
+    {
+        double tTracked;
+        uint64_t key;
+        uint64_t hash;
+    };
+
+    struct DatagramHeader
+    {
+        uint32_t magic;
+        uint32_t node;
+        uint32_t count;
+    };
+
+    struct Seen
+    {
+        uint32_t node;
+        uint64_t hash;
+    };
+
+    static constexpr uint32_t MAGIC = 0x48535244; // "DRSH"
+    static constexpr size_t MAX_RECORDS_PER_DATAGRAM = (1400 - sizeof(DatagramHeader)) / sizeof(Record);
+
+    inline void compare(const Record& record, uint32_t node);
+
+    uint32_t m_node;
+    size_t m_history;
+    uint32_t m_sampleInterval = DEFAULT_SAMPLE_INTERVAL;
+    std::unique_ptr<rs_detail::WinsockScope> m_winsock;
+    sockaddr_in m_group = {};
+    SOCKET m_socket = INVALID_SOCKET;
+    std::vector<Record> m_outgoing;
+    std::vector<uint8_t> m_datagram;
+    std::map<std::pair<double, uint64_t>, Seen> m_seen; // first hash seen for each frame and key
+    std::function<void(const Divergence&)> m_onDivergence;
+    Stats m_stats;
+};
+
+namespace rs_detail
+{
+    // Multiply-accumulate hash in the style of XXH3: 8 64-bit lanes, each stripe of 64 bytes folded in with a 32x32->64
+    // multiply, and the lanes scrambled every kilobyte. Not compatible with XXH3, but as fast, and the same with or
+    // without AVX2.
+    alignas(32) static const uint64_t HASH_KEYS[8] = {
+        0x243F6A8885A308D3ull, 0x13198A2E03707344ull, 0xA4093822299F31D0ull, 0x082EFA98EC4E6C89ull,
+        0x452821E638D01377ull, 0xBE5466CF34E90C6Cull, 0xC0AC29B7C97C50DDull, 0x3F84D5B5B5470917ull,
+    };
+    static const uint64_t HASH_PRIME64_1 = 0x9E3779B185EBCA87ull;
+    static const uint64_t HASH_PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+    static const uint32_t HASH_PRIME32_1 = 0x9E3779B1u;
+    static const size_t HASH_STRIPE = 64;
+    static const size_t HASH_STRIPES_PER_SCRAMBLE = 16;
+
+    inline uint64_t hashAvalanche(uint64_t h)
+    {
+        h ^= h >> 37;
+        h *= 0x165667919E3779F9ull;
+        h ^= h >> 32;
+        return h;
+    }
+
+    inline void hashAccumulate(uint64_t* acc, const uint8_t* stripe)
+    {
+        for (size_t i = 0; i < 8; ++i)
+        {
+            uint64_t data;
+            memcpy(&data, stripe + i * 8, sizeof(data));
+            const uint64_t keyed = data ^ HASH_KEYS[i];
+            acc[i ^ 1] += data;
+            acc[i] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+        }
+    }
+
+    inline void hashScramble(uint64_t* acc)
+    {
+        for (size_t i = 0; i < 8; ++i)
+            acc[i] = (acc[i] ^ (acc[i] >> 47) ^ HASH_KEYS[i]) * HASH_PRIME32_1;
+    }
+
+    // Folds the whole stripes of (data) into (acc)
+    inline void hashStripes(uint64_t* acc, const uint8_t* data, size_t nStripes)
+    {
+        size_t stripe = 0;
+#if defined(__AVX2__)
+        __m256i acc0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc));
+        __m256i acc1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + 4));
+        const __m256i key0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(HASH_KEYS));
+        const __m256i key1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(HASH_KEYS + 4));
+        const __m256i prime = _mm256_set1_epi32(int(HASH_PRIME32_1));
+        auto accumulate = [](__m256i a, __m256i data, __m256i key) {
+            const __m256i keyed = _mm256_xor_si256(data, key);
+            const __m256i product = _mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32));
+            const __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)); // data[i ^ 1]
+            return _mm256_add_epi64(a, _mm256_add_epi64(swapped, product));
+        };
+        auto scramble = [prime](__m256i a, __m256i key) {
+            a = _mm256_xor_si256(_mm256_xor_si256(a, _mm256_srli_epi64(a, 47)), key);
+            const __m256i lo = _mm256_mul_epu32(a, prime);
+            const __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), prime);
+            return _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+        };
+        for (; stripe < nStripes; ++stripe)
+        {
+            const uint8_t* p = data + stripe * HASH_STRIPE;
+            acc0 = accumulate(acc0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), key0);
+            acc1 = accumulate(acc1, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32)), key1);
+            if (stripe % HASH_STRIPES_PER_SCRAMBLE == HASH_STRIPES_PER_SCRAMBLE - 1)
+            {
+                acc0 = scramble(acc0, key0);
+                acc1 = scramble(acc1, key1);
+            }
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc), acc0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + 4), acc1);
+#endif
+        for (; stripe < nStripes; ++stripe)
+        {
+            hashAccumulate(acc, data + stripe * HASH_STRIPE);
+            if (stripe % HASH_STRIPES_PER_SCRAMBLE == HASH_STRIPES_PER_SCRAMBLE - 1)
+                hashScramble(acc);
+        }
+    }
+
+    inline uint64_t hash64(const void* data, size_t size, uint64_t seed)
+    {
+        uint64_t acc[8];
+        for (size_t i = 0; i < 8; ++i)
+            acc[i] = HASH_KEYS[i] ^ (seed + i * HASH_PRIME64_1);
+
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        const size_t nStripes = size / HASH_STRIPE;
+        hashStripes(acc, bytes, nStripes);
+        const size_t tail = size - nStripes * HASH_STRIPE;
+        if (tail > 0)
+        {
+            uint8_t last[HASH_STRIPE] = {};
+            memcpy(last, bytes + nStripes * HASH_STRIPE, tail);
+            hashAccumulate(acc, last);
+        }
+
+        uint64_t h = seed ^ (uint64_t(size) * HASH_PRIME64_1);
+        for (size_t i = 0; i < 8; ++i)
+            h = (h ^ hashAvalanche(acc[i] ^ HASH_KEYS[7 - i])) * HASH_PRIME64_2;
+        return hashAvalanche(h);
+    }
+}
+
+DivergenceDetector::DivergenceDetector(uint32_t node, const char* group, uint16_t port, int ttl, size_t history)
+    : m_node(node), m_history(history)
+{
+    m_winsock = std::make_unique<rs_detail::WinsockScope>();
+    m_group = rs_detail::socketAddress(group, port);
+    m_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (m_socket == INVALID_SOCKET)
+        throw std::runtime_error("Failed to create divergence socket");
+
+    // Every node both sends and receives, so several may share a machine
+    const int reuse = 1;
+    setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+    const sockaddr_in local = rs_detail::socketAddress(nullptr, port);
+    if (bind(m_socket, reinterpret_cast<const sockaddr*>(&local), sizeof(local)) != 0)
+    {
+        closesocket(m_socket);
+        throw std::runtime_error("Failed to bind divergence socket to port " + std::to_string(port));
+    }
+
+    ip_mreq membership = {};
+    membership.imr_multiaddr = m_group.sin_addr;
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    const int loop = 1;
+    if (setsockopt(m_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, reinterpret_cast<const char*>(&membership), sizeof(membership)) != 0)
+    {
+        closesocket(m_socket);
+        throw std::runtime_error(std::string("Failed to join multicast group ") + group);
+    }
+    setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_TTL, reinterpret_cast<const char*>(&ttl), sizeof(ttl));
+    setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_LOOP, reinterpret_cast<const char*>(&loop), sizeof(loop));
+    m_datagram.resize(sizeof(DatagramHeader) + MAX_RECORDS_PER_DATAGRAM * sizeof(Record));
+}
+
+DivergenceDetector::~DivergenceDetector()
+{
+    if (m_socket != INVALID_SOCKET)
+        closesocket(m_socket);
+}
+
+bool DivergenceDetector::sampled(double tTracked) const
+{
+    uint64_t bits;
+    memcpy(&bits, &tTracked, sizeof(bits));
+    return rs_detail::hashAvalanche(bits * rs_detail::HASH_PRIME64_1) % m_sampleInterval == 0;
+}
+
+void DivergenceDetector::hashFrame(double tTracked, const StreamDescription& description, const SenderFrame& frame)
+{
+    if (frame.type != RS_FRAMETYPE_HOST_MEMORY)
+        return;
+    hashRegion(tTracked, rsHashString(description.name), frame, 0, 0, description.width, description.height);
+}
+
+void DivergenceDetector::hashRegion(double tTracked, uint64_t key, const SenderFrame& frame, uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+    if (frame.type != RS_FRAMETYPE_HOST_MEMORY || !sampled(tTracked))
+        return;
+
+    const auto start = std::chrono::steady_clock::now();
+    const uint32_t bytesPerPixel = rsBytesPerPixel(frame.cpu.format);
+    const size_t rowBytes = size_t(width) * bytesPerPixel;
+    // Row by row, so that the hash does not depend on the stride
+    uint64_t hash = key;
+    for (uint32_t row = 0; row < height; ++row)
+    {
+        const uint8_t* pixels = frame.cpu.data + size_t(y + row) * frame.cpu.stride + size_t(x) * bytesPerPixel;
+        hash = rs_detail::hash64(pixels, rowBytes, hash);
+    }
+
+    m_stats.hashed++;
+    m_stats.bytesHashed += rowBytes * height;
+    m_stats.hashSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const Record record = { tTracked, key, hash };
+    m_outgoing.push_back(record);
+    compare(record, m_node);
+}
+
+void DivergenceDetector::exchange()
+{
+    for (size_t first = 0; first < m_outgoing.size(); first += MAX_RECORDS_PER_DATAGRAM)
+    {
+        const DatagramHeader header = { MAGIC, m_node, uint32_t(std::min(MAX_RECORDS_PER_DATAGRAM, m_outgoing.size() - first)) };
+        memcpy(m_datagram.data(), &header, sizeof(header));
+        memcpy(m_datagram.data() + sizeof(header), &m_outgoing[first], header.count * sizeof(Record));
+        if (sendto(m_socket, reinterpret_cast<const char*>(m_datagram.data()), int(sizeof(header) + header.count * sizeof(Record)), 0, reinterpret_cast<const sockaddr*>(&m_group), sizeof(m_group)) < 0)
+            RS_LOG("Failed to send frame hashes, error " << WSAGetLastError());
+    }
+    m_outgoing.clear();
+
+    while (rs_detail::waitReadable(m_socket, 0))
+    {
+        const int received = recv(m_socket, reinterpret_cast<char*>(m_datagram.data()), int(m_datagram.size()), 0);
+        if (received < int(sizeof(DatagramHeader)))
+            continue;
+        DatagramHeader header;
+        memcpy(&header, m_datagram.data(), sizeof(header));
+        if (header.magic != MAGIC || header.node == m_node || header.count > (received - sizeof(header)) / sizeof(Record))
+            continue;
+        for (uint32_t i = 0; i < header.count; ++i)
+        {
+            Record record;
+            memcpy(&record, m_datagram.data() + sizeof(header) + i * sizeof(Record), sizeof(record));
+            m_stats.received++;
+            compare(record, header.node);
+        }
+    }
+}
+
+void DivergenceDetector::compare(const Record& record, uint32_t node)
+{
+    auto inserted = m_seen.emplace(std::make_pair(record.tTracked, record.key), Seen{ node, record.hash });
+    if (inserted.second)
+    {
+        // Forget the oldest frames
+        while (m_seen.size() > m_history)
+            m_seen.erase(m_seen.begin());
+        return;
+    }
+
+    const Seen& seen = inserted.first->second;
+    if (seen.hash == record.hash)
+    {
+        m_stats.matched++;
+        return;
+    }
+
+    m_stats.diverged++;
+    const Divergence divergence = { record.tTracked, record.key, seen.node, seen.hash, node, record.hash };
+    if (m_onDivergence)
+        m_onDivergence(divergence);
+    else
+        RS_LOG("Frame " << record.tTracked << " diverged: node " << seen.node << " hashed key " << record.key << " as " << seen.hash << ", node " << node << " as " << record.hash);
+}
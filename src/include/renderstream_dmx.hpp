@@ -0,0 +1,219 @@
+#pragma once
+
+#include "renderstream.hpp"
+
+#include <cfloat>
+#include <cmath>
+
+#define RS_DMX_UNIVERSE_SIZE 512
+
+typedef std::array<uint8_t, RS_DMX_UNIVERSE_SIZE> DmxUniverse;
+
+// Ranges and DMX channels of every float in the float block of a scene (see ParameterValues::floats).
+// Numbers use the min, max and step of their NumericalDefaults; pose and transform floats are unbounded and have no channel.
+// Channels are 0-based across consecutive universes (universe * 512 + slot). Parameters with a dmxOffset of -1 are
+// allocated the first free channels after all explicitly placed parameters have been assigned.
+// RS_DMX_DEFAULT is encoded as RS_DMX_16_BE.
+struct NumericLayout
+{
+    inline explicit NumericLayout(const RemoteParameters& scene);
+
+    std::vector<float> min, max, step;
+    std::vector<float> invStep, invRange; // 0 where step or range is 0
+    std::vector<int32_t> dmxChannel; // -1 if not mapped
+    std::vector<uint8_t> dmxWidth; // bytes
+    size_t nUniverses = 0;
+
+    size_t size() const { return min.size(); }
+};
+
+NumericLayout::NumericLayout(const RemoteParameters& scene)
+{
+    struct Placement
+    {
+        uint32_t iFloat;
+        int32_t offset;
+        uint8_t width;
+    };
+    std::vector<Placement> placements;
+
+    for (uint32_t iParam = 0; iParam < scene.nParameters; ++iParam)
+    {
+        const RemoteParameter& param = scene.parameters[iParam];
+        if (param.flags & REMOTEPARAMETER_READ_ONLY)
+            continue;
+
+        const uint32_t nFloats = rsParameterFloatCount(param.type);
+        for (uint32_t i = 0; i < nFloats; ++i)
+        {
+            if (param.type == RS_PARAMETER_NUMBER)
+            {
+                const NumericalDefaults& defaults = param.defaults.number;
+                min.push_back(defaults.min);
+                max.push_back(defaults.max);
+                step.push_back(defaults.step);
+                invStep.push_back(defaults.step > 0.f ? 1.f / defaults.step : 0.f);
+                invRange.push_back(defaults.max > defaults.min ? 1.f / (defaults.max - defaults.min) : 0.f);
+                placements.push_back({ uint32_t(dmxChannel.size()), param.dmxOffset, uint8_t(param.dmxType == RS_DMX_8 ? 1 : 2) });
+            }
+            else
+            {
+                min.push_back(-FLT_MAX);
+                max.push_back(FLT_MAX);
+                step.push_back(0.f);
+                invStep.push_back(0.f);
+                invRange.push_back(0.f);
+            }
+            dmxChannel.push_back(-1);
+            dmxWidth.push_back(0);
+        }
+    }
+
+    std::vector<bool> occupied;
+    auto fits = [&](int32_t channel, uint8_t width) {
+        // Multi-byte values may not straddle a universe boundary
+        if (channel % RS_DMX_UNIVERSE_SIZE + width > RS_DMX_UNIVERSE_SIZE)
+            return false;
+        for (int32_t c = channel; c < channel + width; ++c)
+        {
+            if (size_t(c) < occupied.size() && occupied[c])
+                return false;
+        }
+        return true;
+    };
+    auto place = [&](const Placement& placement, int32_t channel) {
+        if (occupied.size() < size_t(channel + placement.width))
+            occupied.resize(channel + placement.width, false);
+        for (int32_t c = channel; c < channel + placement.width; ++c)
+            occupied[c] = true;
+        dmxChannel[placement.iFloat] = channel;
+        dmxWidth[placement.iFloat] = placement.width;
+    };
+
+    for (const Placement& placement : placements)
+    {
+        if (placement.offset < 0)
+            continue;
+        if (!fits(placement.offset, placement.width))
+            throw std::runtime_error("Overlapping or misaligned DMX channel " + std::to_string(placement.offset));
+        place(placement, placement.offset);
+    }
+
+    int32_t cursor = 0;
+    for (const Placement& placement : placements)
+    {
+        if (placement.offset >= 0)
+            continue;
+        while (!fits(cursor, placement.width))
+            ++cursor;
+        place(placement, cursor);
+    }
+
+    nUniverses = (occupied.size() + RS_DMX_UNIVERSE_SIZE - 1) / RS_DMX_UNIVERSE_SIZE;
+}
+
+// Clamps each float in (in) to its range and rounds it to the nearest step above the minimum, writing the result to
+// (clamped) and the position of the result within its range (0-1) to (normalised), in a single pass. Either output may be
+// null, and may alias (in).
+inline void rsClampQuantiseNormalise(const NumericLayout& layout, const float* in, float* clamped, float* normalised)
+{
+    const size_t n = layout.size();
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256 zero = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256 lo = _mm256_loadu_ps(&layout.min[i]);
+        const __m256 hi = _mm256_loadu_ps(&layout.max[i]);
+        const __m256 step = _mm256_loadu_ps(&layout.step[i]);
+        __m256 v = _mm256_max_ps(lo, _mm256_min_ps(hi, _mm256_loadu_ps(in + i)));
+        const __m256 steps = _mm256_round_ps(_mm256_mul_ps(_mm256_sub_ps(v, lo), _mm256_loadu_ps(&layout.invStep[i])), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        const __m256 quantised = _mm256_min_ps(hi, _mm256_add_ps(lo, _mm256_mul_ps(steps, step)));
+        v = _mm256_blendv_ps(v, quantised, _mm256_cmp_ps(step, zero, _CMP_GT_OQ));
+        if (clamped)
+            _mm256_storeu_ps(clamped + i, v);
+        if (normalised)
+            _mm256_storeu_ps(normalised + i, _mm256_mul_ps(_mm256_sub_ps(v, lo), _mm256_loadu_ps(&layout.invRange[i])));
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        float v = std::max(layout.min[i], std::min(layout.max[i], in[i]));
+        if (layout.step[i] > 0.f)
+            v = std::min(layout.max[i], layout.min[i] + std::nearbyint((v - layout.min[i]) * layout.invStep[i]) * layout.step[i]);
+        if (clamped)
+            clamped[i] = v;
+        if (normalised)
+            normalised[i] = (v - layout.min[i]) * layout.invRange[i];
+    }
+}
+
+// Writes the mapped floats of (normalised) into (universes), as 8-bit or 16-bit big-endian values. Unmapped channels are untouched.
+inline void rsEncodeDmx(const NumericLayout& layout, const float* normalised, std::vector<DmxUniverse>& universes)
+{
+    if (universes.size() < layout.nUniverses)
+        universes.resize(layout.nUniverses, DmxUniverse{});
+
+    const size_t n = layout.size();
+    int32_t scaled[8];
+    for (size_t first = 0; first < n; first += 8)
+    {
+        const size_t count = std::min<size_t>(8, n - first);
+#if defined(__AVX2__)
+        if (count == 8)
+        {
+            // Scale everything to 16 bits, 8-bit channels are rescaled below
+            const __m256 v = _mm256_max_ps(_mm256_setzero_ps(), _mm256_min_ps(_mm256_set1_ps(1.f), _mm256_loadu_ps(normalised + first)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(scaled), _mm256_cvtps_epi32(_mm256_mul_ps(v, _mm256_set1_ps(65535.f))));
+        }
+        else
+#endif
+        {
+            for (size_t i = 0; i < count; ++i)
+                scaled[i] = int32_t(std::nearbyint(std::max(0.f, std::min(1.f, normalised[first + i])) * 65535.f));
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const int32_t channel = layout.dmxChannel[first + i];
+            if (channel < 0)
+                continue;
+            // Channels never straddle a universe boundary
+            uint8_t* data = &universes[channel / RS_DMX_UNIVERSE_SIZE][channel % RS_DMX_UNIVERSE_SIZE];
+            if (layout.dmxWidth[first + i] == 1)
+            {
+                // Round to 8 bits from the 16-bit value: x * 255 / 65535 == x / 257
+                data[0] = uint8_t((scaled[i] + 128) / 257);
+            }
+            else
+            {
+                data[0] = uint8_t(scaled[i] >> 8);
+                data[1] = uint8_t(scaled[i] & 0xff);
+            }
+        }
+    }
+}
+
+// Inverse of rsEncodeDmx followed by rsClampQuantiseNormalise: writes the value of each mapped float to (out), quantised
+// to its step. Unmapped floats in (out) are untouched.
+inline void rsDecodeDmx(const NumericLayout& layout, const std::vector<DmxUniverse>& universes, float* out)
+{
+    if (universes.size() < layout.nUniverses)
+        throw std::runtime_error("Not enough DMX universes for layout");
+
+    for (size_t i = 0; i < layout.size(); ++i)
+    {
+        const int32_t channel = layout.dmxChannel[i];
+        if (channel < 0)
+            continue;
+
+        const uint8_t* data = &universes[channel / RS_DMX_UNIVERSE_SIZE][channel % RS_DMX_UNIVERSE_SIZE];
+        const float normalised = layout.dmxWidth[i] == 1
+            ? data[0] / 255.f
+            : ((uint32_t(data[0]) << 8) | data[1]) / 65535.f;
+        float v = layout.min[i] + normalised * (layout.max[i] - layout.min[i]);
+        if (layout.step[i] > 0.f)
+            v = std::min(layout.max[i], layout.min[i] + std::nearbyint((v - layout.min[i]) * layout.invStep[i]) * layout.step[i]);
+        out[i] = v;
+    }
+}
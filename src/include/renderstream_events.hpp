@@ -0,0 +1,187 @@
+#pragma once
+
+#include "renderstream.hpp"
+
+#include <atomic>
+#include <memory>
+
+// Bounded lock-free queue. Any number of threads may push, a single thread may pop.
+// Capacity is rounded up to a power of two.
+template <typename T>
+class EventQueue
+{
+public:
+    explicit EventQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size *= 2;
+        m_cells.reset(new Cell[size]);
+        m_mask = size - 1;
+        for (size_t i = 0; i < size; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    EventQueue(const EventQueue&) = delete;
+    EventQueue& operator=(const EventQueue&) = delete;
+
+    // Returns false if the queue is full.
+    bool push(const T& value)
+    {
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell& cell = m_cells[pos & m_mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = intptr_t(sequence) - intptr_t(pos);
+            if (diff == 0)
+            {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer thread only. Returns false if the queue is empty.
+    bool pop(T& out)
+    {
+        Cell& cell = m_cells[m_dequeuePos & m_mask];
+        if (cell.sequence.load(std::memory_order_acquire) != m_dequeuePos + 1)
+            return false;
+
+        out = std::move(cell.value);
+        cell.sequence.store(m_dequeuePos + m_mask + 1, std::memory_order_release);
+        ++m_dequeuePos;
+        return true;
+    }
+
+    // Consumer thread only. Calls fn(T&) for every queued element, returns the number of elements.
+    template <typename Fn>
+    size_t drain(Fn&& fn)
+    {
+        size_t n = 0;
+        T value;
+        while (pop(value))
+        {
+            fn(value);
+            ++n;
+        }
+        return n;
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    size_t m_mask = 0;
+    alignas(64) std::atomic<size_t> m_enqueuePos = { 0 };
+    alignas(64) size_t m_dequeuePos = 0;
+};
+
+// An event parameter which was triggered on the frame requested at tTracked.
+struct ParameterEvent
+{
+    double tTracked;
+    uint64_t schemaHash;
+    const char* key; // owned by the schema
+    uint32_t count; // number of triggers since the previous frame, including skipped frames
+};
+
+// Delivers event parameters to any number of consumer threads, each with its own queue.
+//
+// Usage:
+//     auto renderEvents = dispatcher.subscribe();  // before the frame loop
+//     ...
+//     ParameterValues values = rs.getFrameParameters(scene);
+//     dispatcher.dispatch(frameData, values);
+//     ...
+//     renderEvents->drain([](ParameterEvent& e) { ... });  // on the render thread
+class ParameterEventDispatcher
+{
+public:
+    static const size_t DEFAULT_CAPACITY = 1024;
+
+    // Not thread-safe - subscribe before dispatching.
+    inline std::shared_ptr<EventQueue<ParameterEvent>> subscribe(size_t capacity = DEFAULT_CAPACITY);
+
+    // Queues every event triggered this frame. Events which do not fit in a subscriber's queue are kept and retried on the next dispatch.
+    inline void dispatch(const FrameData& frame, ParameterValues& values);
+
+    // Events waiting for space in a full subscriber queue
+    inline size_t deferred() const;
+
+private:
+    struct Subscriber
+    {
+        std::shared_ptr<EventQueue<ParameterEvent>> queue;
+        std::vector<ParameterEvent> deferred;
+    };
+
+    std::vector<Subscriber> m_subscribers;
+    std::vector<ParameterEvent> m_frameEvents;
+};
+
+std::shared_ptr<EventQueue<ParameterEvent>> ParameterEventDispatcher::subscribe(size_t capacity)
+{
+    Subscriber subscriber;
+    subscriber.queue = std::make_shared<EventQueue<ParameterEvent>>(capacity);
+    m_subscribers.push_back(subscriber);
+    return subscriber.queue;
+}
+
+void ParameterEventDispatcher::dispatch(const FrameData& frame, ParameterValues& values)
+{
+    m_frameEvents.clear();
+    const RemoteParameters& scene = values.scene();
+    for (uint32_t iParam = 0; iParam < scene.nParameters; ++iParam)
+    {
+        const RemoteParameter& param = scene.parameters[iParam];
+        if (param.type != RS_PARAMETER_EVENT || (param.flags & REMOTEPARAMETER_READ_ONLY))
+            continue;
+
+        const uint32_t count = values.eventCount(param.key);
+        if (count > 0)
+            m_frameEvents.push_back({ frame.tTracked, scene.hash, param.key, count });
+    }
+
+    for (Subscriber& subscriber : m_subscribers)
+    {
+        // Preserve ordering: older deferred events go first
+        size_t nPushed = 0;
+        while (nPushed < subscriber.deferred.size() && subscriber.queue->push(subscriber.deferred[nPushed]))
+            ++nPushed;
+        subscriber.deferred.erase(subscriber.deferred.begin(), subscriber.deferred.begin() + nPushed);
+
+        for (const ParameterEvent& event : m_frameEvents)
+        {
+            if (!subscriber.deferred.empty() || !subscriber.queue->push(event))
+                subscriber.deferred.push_back(event);
+        }
+    }
+}
+
+size_t ParameterEventDispatcher::deferred() const
+{
+    size_t n = 0;
+    for (const Subscriber& subscriber : m_subscribers)
+        n += subscriber.deferred.size();
+    return n;
+}
@@ -0,0 +1,735 @@
+#pragma once
+
+#include "renderstream.hpp"
+#include "renderstream_frame_events.hpp"
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#pragma comment(lib, "Ws2_32.lib")
+
+// Replicates FrameData and application state from a controller node to its followers.
+//
+// Controller:
+//     FollowerController controller(std::make_unique<UdpFollowerTransport>(UdpFollowerTransport::controller("239.0.0.1", 7000)));
+//     auto result = rs.awaitFrameData(5000);
+//     const std::vector<ExternalEvent>& stamped = events.stamp(frameData);  // optional, see FrameEventQueue
+//     ... simulate ...
+//     controller.publish(frameData, state.data(), state.size(), stamped);
+//     ... render and sendFrame ...
+//
+// Follower:
+//     Follower follower(rs, std::make_unique<UdpFollowerTransport>(UdpFollowerTransport::follower("239.0.0.1", 7000)));
+//     auto result = follower.awaitFrame(5000);  // in place of awaitFrameData, handled the same way
+//     ... apply follower.lastFrame().state, render and sendFrame ...
+
+// Moves serialised frames from the controller to every follower. Each transport instance is either a sender or a receiver.
+class FollowerTransport
+{
+public:
+    virtual ~FollowerTransport() = default;
+
+    // Controller only
+    virtual void send(const uint8_t* data, size_t size) = 0;
+    // Follower only. Returns false if no complete message arrived within (timeoutMs).
+    virtual bool receive(std::vector<uint8_t>& out, int timeoutMs) = 0;
+};
+
+namespace rs_detail
+{
+    class WinsockScope
+    {
+    public:
+        WinsockScope()
+        {
+            WSADATA data;
+            if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+                throw std::runtime_error("Failed to initialise Winsock");
+        }
+        ~WinsockScope() { WSACleanup(); }
+        WinsockScope(const WinsockScope&) = delete;
+        WinsockScope& operator=(const WinsockScope&) = delete;
+    };
+
+    inline sockaddr_in socketAddress(const char* host, uint16_t port)
+    {
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        if (!host)
+        {
+            address.sin_addr.s_addr = htonl(INADDR_ANY);
+        }
+        else if (inet_pton(AF_INET, host, &address.sin_addr) != 1)
+        {
+            addrinfo hints = {};
+            hints.ai_family = AF_INET;
+            addrinfo* result = nullptr;
+            if (getaddrinfo(host, nullptr, &hints, &result) != 0 || !result)
+                throw std::runtime_error(std::string("Failed to resolve host '") + host + "'");
+            address.sin_addr = reinterpret_cast<const sockaddr_in*>(result->ai_addr)->sin_addr;
+            freeaddrinfo(result);
+        }
+        return address;
+    }
+
+    // Waits up to (timeoutMs) for (socket) to become readable
+    inline bool waitReadable(SOCKET socket, int timeoutMs)
+    {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(socket, &readable);
+        timeval timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+        // nfds is ignored by Winsock
+        return select(int(socket) + 1, &readable, nullptr, nullptr, &timeout) > 0;
+    }
+
+    inline int64_t wallClockMicroseconds()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+}
+
+// Length-prefixed messages over TCP. The controller accepts any number of followers, and a follower reconnects if the
+// controller goes away. Reliable, so every follower sees every frame, at the cost of the controller blocking on slow followers.
+class TcpFollowerTransport : public FollowerTransport
+{
+public:
+    static inline TcpFollowerTransport controller(uint16_t port);
+    static inline TcpFollowerTransport follower(const char* host, uint16_t port);
+
+    inline ~TcpFollowerTransport() override;
+    inline TcpFollowerTransport(TcpFollowerTransport&& other) noexcept;
+    TcpFollowerTransport(const TcpFollowerTransport&) = delete;
+    TcpFollowerTransport& operator=(const TcpFollowerTransport&) = delete;
+
+    inline void send(const uint8_t* data, size_t size) override;
+    inline bool receive(std::vector<uint8_t>& out, int timeoutMs) override;
+
+    size_t connectedFollowers() const { return m_clients.size(); }
+
+private:
+    TcpFollowerTransport() = default;
+    inline bool connectToController();
+    static inline bool sendAll(SOCKET socket, const uint8_t* data, size_t size);
+    static inline bool receiveAll(SOCKET socket, uint8_t* data, size_t size);
+
+    std::unique_ptr<rs_detail::WinsockScope> m_winsock;
+    sockaddr_in m_address = {};
+    SOCKET m_socket = INVALID_SOCKET; // listening socket on the controller, connection on a follower
+    std::vector<SOCKET> m_clients;
+};
+
+TcpFollowerTransport TcpFollowerTransport::controller(uint16_t port)
+{
+    TcpFollowerTransport transport;
+    transport.m_winsock = std::make_unique<rs_detail::WinsockScope>();
+    transport.m_address = rs_detail::socketAddress(nullptr, port);
+    transport.m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (transport.m_socket == INVALID_SOCKET)
+        throw std::runtime_error("Failed to create follower socket");
+
+    const int reuse = 1;
+    setsockopt(transport.m_socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+    if (bind(transport.m_socket, reinterpret_cast<const sockaddr*>(&transport.m_address), sizeof(transport.m_address)) != 0 || listen(transport.m_socket, SOMAXCONN) != 0)
+        throw std::runtime_error("Failed to listen for followers on port " + std::to_string(port));
+
+    // Followers are accepted at the start of each send
+    unsigned long nonBlocking = 1;
+    ioctlsocket(transport.m_socket, FIONBIO, &nonBlocking);
+    return transport;
+}
+
+TcpFollowerTransport TcpFollowerTransport::follower(const char* host, uint16_t port)
+{
+    TcpFollowerTransport transport;
+    transport.m_winsock = std::make_unique<rs_detail::WinsockScope>();
+    transport.m_address = rs_detail::socketAddress(host, port);
+    transport.connectToController();
+    return transport;
+}
+
+TcpFollowerTransport::~TcpFollowerTransport()
+{
+    for (SOCKET client : m_clients)
+        closesocket(client);
+    if (m_socket != INVALID_SOCKET)
+        closesocket(m_socket);
+}
+
+TcpFollowerTransport::TcpFollowerTransport(TcpFollowerTransport&& other) noexcept
+    : m_winsock(std::move(other.m_winsock)), m_address(other.m_address), m_socket(other.m_socket), m_clients(std::move(other.m_clients))
+{
+    other.m_socket = INVALID_SOCKET;
+    other.m_clients.clear();
+}
+
+bool TcpFollowerTransport::connectToController()
+{
+    m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (m_socket == INVALID_SOCKET)
+        throw std::runtime_error("Failed to create follower socket");
+    if (connect(m_socket, reinterpret_cast<const sockaddr*>(&m_address), sizeof(m_address)) != 0)
+    {
+        closesocket(m_socket);
+        m_socket = INVALID_SOCKET;
+        return false;
+    }
+    const int noDelay = 1;
+    setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+    return true;
+}
+
+bool TcpFollowerTransport::sendAll(SOCKET socket, const uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        const int sent = ::send(socket, reinterpret_cast<const char*>(data), int(std::min<size_t>(size, INT32_MAX)), 0);
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+bool TcpFollowerTransport::receiveAll(SOCKET socket, uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        const int received = recv(socket, reinterpret_cast<char*>(data), int(std::min<size_t>(size, INT32_MAX)), 0);
+        if (received <= 0)
+            return false;
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+void TcpFollowerTransport::send(const uint8_t* data, size_t size)
+{
+    while (true)
+    {
+        SOCKET client = accept(m_socket, nullptr, nullptr);
+        if (client == INVALID_SOCKET)
+            break;
+        unsigned long blocking = 0;
+        ioctlsocket(client, FIONBIO, &blocking);
+        const int noDelay = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+        m_clients.push_back(client);
+        RS_LOG("Follower connected, " << m_clients.size() << " followers");
+    }
+
+    const uint32_t length = uint32_t(size);
+    for (size_t i = 0; i < m_clients.size();)
+    {
+        if (sendAll(m_clients[i], reinterpret_cast<const uint8_t*>(&length), sizeof(length)) && sendAll(m_clients[i], data, size))
+        {
+            ++i;
+            continue;
+        }
+        RS_LOG("Follower disconnected");
+        closesocket(m_clients[i]);
+        m_clients.erase(m_clients.begin() + i);
+    }
+}
+
+bool TcpFollowerTransport::receive(std::vector<uint8_t>& out, int timeoutMs)
+{
+    // Keep trying to connect for the whole timeout, as the controller may not be listening yet
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (m_socket == INVALID_SOCKET && !connectToController())
+    {
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= deadline)
+            return false;
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(deadline - now, std::chrono::milliseconds(100)));
+    }
+    const int remainingMs = int(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count()));
+    if (!rs_detail::waitReadable(m_socket, remainingMs))
+        return false;
+
+    uint32_t length = 0;
+    if (receiveAll(m_socket, reinterpret_cast<uint8_t*>(&length), sizeof(length)))
+    {
+        out.resize(length);
+        if (receiveAll(m_socket, out.data(), length))
+            return true;
+    }
+    RS_LOG("Lost connection to controller");
+    closesocket(m_socket);
+    m_socket = INVALID_SOCKET;
+    return false;
+}
+
+// Multicast UDP. One datagram reaches every follower on the subnet, so the controller's cost does not grow with the
+// number of followers. Messages are split into fragments; a frame with a lost fragment is dropped, and shows up as a
+// dropped frame in the follower's stats.
+class UdpFollowerTransport : public FollowerTransport
+{
+public:
+    static constexpr size_t MAX_FRAGMENT_PAYLOAD = 1400; // fits a standard ethernet MTU
+
+    static inline UdpFollowerTransport controller(const char* group, uint16_t port, int ttl = 1);
+    static inline UdpFollowerTransport follower(const char* group, uint16_t port);
+
+    inline ~UdpFollowerTransport() override;
+    inline UdpFollowerTransport(UdpFollowerTransport&& other) noexcept;
+    UdpFollowerTransport(const UdpFollowerTransport&) = delete;
+    UdpFollowerTransport& operator=(const UdpFollowerTransport&) = delete;
+
+    inline void send(const uint8_t* data, size_t size) override;
+    inline bool receive(std::vector<uint8_t>& out, int timeoutMs) override;
+
+private:
+    struct FragmentHeader
+    {
+        uint64_t message;
+        uint32_t totalSize;
+        uint16_t index;
+        uint16_t count;
+    };
+
+    UdpFollowerTransport() = default;
+
+    std::unique_ptr<rs_detail::WinsockScope> m_winsock;
+    sockaddr_in m_group = {};
+    SOCKET m_socket = INVALID_SOCKET;
+    uint64_t m_message = 0;
+
+    // Reassembly on followers
+    std::vector<uint8_t> m_datagram;
+    std::vector<uint8_t> m_received; // per fragment of m_message
+    uint32_t m_nReceived = 0;
+};
+
+UdpFollowerTransport UdpFollowerTransport::controller(const char* group, uint16_t port, int ttl)
+{
+    UdpFollowerTransport transport;
+    transport.m_winsock = std::make_unique<rs_detail::WinsockScope>();
+    transport.m_group = rs_detail::socketAddress(group, port);
+    transport.m_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (transport.m_socket == INVALID_SOCKET)
+        throw std::runtime_error("Failed to create follower socket");
+
+    // Loopback lets followers on the controller's machine receive frames too
+    const int loop = 1;
+    setsockopt(transport.m_socket, IPPROTO_IP, IP_MULTICAST_TTL, reinterpret_cast<const char*>(&ttl), sizeof(ttl));
+    setsockopt(transport.m_socket, IPPROTO_IP, IP_MULTICAST_LOOP, reinterpret_cast<const char*>(&loop), sizeof(loop));
+    return transport;
+}
+
+UdpFollowerTransport UdpFollowerTransport::follower(const char* group, uint16_t port)
+{
+    UdpFollowerTransport transport;
+    transport.m_winsock = std::make_unique<rs_detail::WinsockScope>();
+    transport.m_group = rs_detail::socketAddress(group, port);
+    transport.m_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (transport.m_socket == INVALID_SOCKET)
+        throw std::runtime_error("Failed to create follower socket");
+
+    const int reuse = 1;
+    setsockopt(transport.m_socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+    const sockaddr_in local = rs_detail::socketAddress(nullptr, port);
+    if (bind(transport.m_socket, reinterpret_cast<const sockaddr*>(&local), sizeof(local)) != 0)
+        throw std::runtime_error("Failed to bind follower socket to port " + std::to_string(port));
+
+    ip_mreq membership = {};
+    membership.imr_multiaddr = transport.m_group.sin_addr;
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(transport.m_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, reinterpret_cast<const char*>(&membership), sizeof(membership)) != 0)
+        throw std::runtime_error(std::string("Failed to join multicast group ") + group);
+
+    // Room for a burst of fragments while the follower is busy rendering
+    const int bufferSize = 8 * 1024 * 1024;
+    setsockopt(transport.m_socket, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize));
+    transport.m_datagram.resize(sizeof(FragmentHeader) + MAX_FRAGMENT_PAYLOAD);
+    return transport;
+}
+
+UdpFollowerTransport::~UdpFollowerTransport()
+{
+    if (m_socket != INVALID_SOCKET)
+        closesocket(m_socket);
+}
+
+UdpFollowerTransport::UdpFollowerTransport(UdpFollowerTransport&& other) noexcept
+    : m_winsock(std::move(other.m_winsock)), m_group(other.m_group), m_socket(other.m_socket), m_message(other.m_message),
+      m_datagram(std::move(other.m_datagram)), m_received(std::move(other.m_received)), m_nReceived(other.m_nReceived)
+{
+    other.m_socket = INVALID_SOCKET;
+}
+
+void UdpFollowerTransport::send(const uint8_t* data, size_t size)
+{
+    const size_t nFragments = std::max<size_t>(1, (size + MAX_FRAGMENT_PAYLOAD - 1) / MAX_FRAGMENT_PAYLOAD);
+    if (nFragments > UINT16_MAX)
+        throw std::runtime_error("Follower message too large for UDP transport");
+
+    ++m_message;
+    m_datagram.resize(sizeof(FragmentHeader) + MAX_FRAGMENT_PAYLOAD);
+    for (size_t i = 0; i < nFragments; ++i)
+    {
+        const size_t offset = i * MAX_FRAGMENT_PAYLOAD;
+        const size_t payload = std::min(MAX_FRAGMENT_PAYLOAD, size - offset);
+        const FragmentHeader header = { m_message, uint32_t(size), uint16_t(i), uint16_t(nFragments) };
+        memcpy(m_datagram.data(), &header, sizeof(header));
+        if (payload > 0)
+            memcpy(m_datagram.data() + sizeof(header), data + offset, payload);
+        if (sendto(m_socket, reinterpret_cast<const char*>(m_datagram.data()), int(sizeof(header) + payload), 0, reinterpret_cast<const sockaddr*>(&m_group), sizeof(m_group)) < 0)
+            RS_LOG("Failed to send follower fragment, error " << WSAGetLastError());
+    }
+}
+
+bool UdpFollowerTransport::receive(std::vector<uint8_t>& out, int timeoutMs)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (true)
+    {
+        const int remainingMs = int(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count());
+        if (!rs_detail::waitReadable(m_socket, std::max(remainingMs, 0)))
+            return false;
+
+        const int received = recv(m_socket, reinterpret_cast<char*>(m_datagram.data()), int(m_datagram.size()), 0);
+        if (received < int(sizeof(FragmentHeader)))
+            continue;
+        FragmentHeader header;
+        memcpy(&header, m_datagram.data(), sizeof(header));
+        const size_t payload = received - sizeof(header);
+        const size_t offset = size_t(header.index) * MAX_FRAGMENT_PAYLOAD;
+        if (header.index >= header.count || offset + payload > header.totalSize)
+            continue;
+
+        // A fragment of a newer message abandons the current one
+        if (header.message != m_message || m_received.size() != header.count)
+        {
+            if (header.message < m_message && m_message - header.message < (1ull << 32))
+                continue; // late fragment of an older message
+            m_message = header.message;
+            m_received.assign(header.count, 0);
+            m_nReceived = 0;
+            out.resize(header.totalSize);
+        }
+        if (m_received[header.index])
+            continue;
+
+        memcpy(out.data() + offset, m_datagram.data() + sizeof(header), payload);
+        m_received[header.index] = 1;
+        if (++m_nReceived == header.count)
+        {
+            m_received.clear();
+            return true;
+        }
+    }
+}
+
+// Seqlocked shared memory, for followers on the same machine as the controller. Followers poll for new messages,
+// and skip any they were too slow to read.
+class SharedMemoryFollowerTransport : public FollowerTransport
+{
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 16 * 1024 * 1024;
+
+    // Creates the named mapping
+    static inline SharedMemoryFollowerTransport controller(const char* name, size_t capacity = DEFAULT_CAPACITY);
+    // Opens the named mapping, waiting for the controller to create it
+    static inline SharedMemoryFollowerTransport follower(const char* name);
+
+    inline ~SharedMemoryFollowerTransport() override;
+    inline SharedMemoryFollowerTransport(SharedMemoryFollowerTransport&& other) noexcept;
+    SharedMemoryFollowerTransport(const SharedMemoryFollowerTransport&) = delete;
+    SharedMemoryFollowerTransport& operator=(const SharedMemoryFollowerTransport&) = delete;
+
+    inline void send(const uint8_t* data, size_t size) override;
+    inline bool receive(std::vector<uint8_t>& out, int timeoutMs) override;
+
+private:
+    struct Header
+    {
+        std::atomic<uint64_t> sequence; // odd while the controller is writing
+        std::atomic<uint64_t> size;
+        uint64_t capacity;
+    };
+
+    SharedMemoryFollowerTransport() = default;
+    inline bool open();
+
+    std::string m_name;
+    HANDLE m_mapping = nullptr;
+    Header* m_header = nullptr;
+    uint8_t* m_data = nullptr;
+    uint64_t m_lastSequence = 0;
+};
+
+SharedMemoryFollowerTransport SharedMemoryFollowerTransport::controller(const char* name, size_t capacity)
+{
+    SharedMemoryFollowerTransport transport;
+    transport.m_name = name;
+    const uint64_t size = sizeof(Header) + capacity;
+    transport.m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, DWORD(size >> 32), DWORD(size), name);
+    if (!transport.m_mapping)
+        throw std::runtime_error(std::string("Failed to create follower shared memory '") + name + "'");
+    void* view = MapViewOfFile(transport.m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (!view)
+        throw std::runtime_error(std::string("Failed to map follower shared memory '") + name + "'");
+
+    transport.m_header = new (view) Header();
+    transport.m_header->sequence.store(0, std::memory_order_relaxed);
+    transport.m_header->size.store(0, std::memory_order_relaxed);
+    transport.m_header->capacity = capacity;
+    transport.m_data = reinterpret_cast<uint8_t*>(transport.m_header + 1);
+    return transport;
+}
+
+SharedMemoryFollowerTransport SharedMemoryFollowerTransport::follower(const char* name)
+{
+    SharedMemoryFollowerTransport transport;
+    transport.m_name = name;
+    transport.open();
+    return transport;
+}
+
+SharedMemoryFollowerTransport::~SharedMemoryFollowerTransport()
+{
+    if (m_header)
+        UnmapViewOfFile(m_header);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+}
+
+SharedMemoryFollowerTransport::SharedMemoryFollowerTransport(SharedMemoryFollowerTransport&& other) noexcept
+    : m_name(std::move(other.m_name)), m_mapping(other.m_mapping), m_header(other.m_header), m_data(other.m_data), m_lastSequence(other.m_lastSequence)
+{
+    other.m_mapping = nullptr;
+    other.m_header = nullptr;
+    other.m_data = nullptr;
+}
+
+bool SharedMemoryFollowerTransport::open()
+{
+    m_mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, m_name.c_str());
+    if (!m_mapping)
+        return false;
+    void* view = MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (!view)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+        return false;
+    }
+    m_header = static_cast<Header*>(view);
+    m_data = reinterpret_cast<uint8_t*>(m_header + 1);
+    return true;
+}
+
+void SharedMemoryFollowerTransport::send(const uint8_t* data, size_t size)
+{
+    if (size > m_header->capacity)
+        throw std::runtime_error("Follower message too large for shared memory transport");
+
+    const uint64_t sequence = m_header->sequence.load(std::memory_order_relaxed);
+    m_header->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(m_data, data, size);
+    m_header->size.store(size, std::memory_order_relaxed);
+    m_header->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool SharedMemoryFollowerTransport::receive(std::vector<uint8_t>& out, int timeoutMs)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (uint32_t spin = 0;; ++spin)
+    {
+        if (m_header || open())
+        {
+            const uint64_t before = m_header->sequence.load(std::memory_order_acquire);
+            if (before % 2 == 0 && before != m_lastSequence)
+            {
+                const uint64_t size = std::min(m_header->size.load(std::memory_order_relaxed), m_header->capacity);
+                out.resize(size);
+                memcpy(out.data(), m_data, size);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (m_header->sequence.load(std::memory_order_relaxed) == before)
+                {
+                    m_lastSequence = before;
+                    return true;
+                }
+                continue; // overwritten while copying
+            }
+        }
+
+        if (std::chrono::steady_clock::now() >= deadline)
+            return false;
+        // Spin briefly for latency, then stop burning the core
+        if (spin < 1000)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+// The message published by a controller for each frame.
+struct FollowerFrame
+{
+    uint64_t sequence = 0;
+    FrameData frame = {};
+    std::vector<uint8_t> state; // application-defined
+    std::vector<ExternalEvent> events; // stamped by the controller's FrameEventQueue
+    double latencySeconds = 0; // controller publish to follower receipt, by the wall clocks of both nodes
+};
+
+namespace rs_detail
+{
+    const uint32_t FOLLOWER_MESSAGE_MAGIC = 0x46535244; // "DRSF"
+    const uint32_t FOLLOWER_MESSAGE_VERSION = 2;
+
+    struct FollowerMessageHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t sequence;
+        int64_t publishTimeUs; // wall clock
+        FrameData frame;
+        uint64_t stateSize;
+        uint64_t eventCount; // after the state
+    };
+}
+
+// Publishes each frame to the followers.
+class FollowerController
+{
+public:
+    inline explicit FollowerController(std::unique_ptr<FollowerTransport> transport);
+
+    // Call once per frame after simulating, before rendering. (state) is passed to followers unchanged.
+    inline void publish(const FrameData& frame, const void* state, size_t size, const std::vector<ExternalEvent>& events = {});
+
+private:
+    std::unique_ptr<FollowerTransport> m_transport;
+    uint64_t m_sequence = 0;
+    std::vector<uint8_t> m_message;
+};
+
+// Receives frames from the controller and begins them with rs_beginFollowerFrame, in place of awaitFrameData.
+class Follower
+{
+public:
+    struct Stats
+    {
+        uint64_t frames = 0;
+        uint64_t dropped = 0; // frames published by the controller that never arrived
+        double lastLatencySeconds = 0;
+        double maxLatencySeconds = 0;
+        double meanLatencySeconds = 0;
+    };
+
+    // Marks this node as a follower
+    inline Follower(RenderStream& rs, std::unique_ptr<FollowerTransport> transport);
+
+    // Blocks until the next frame from the controller arrives, then begins it. Returns RS_ERROR_TIMEOUT if no frame
+    // arrived within (timeoutMs), or any error from rs_beginFollowerFrame. After RS_ERROR_STREAMS_CHANGED, update the
+    // streams and call again: the same frame is begun again rather than waiting for a new one.
+    inline std::variant<FrameData, RS_ERROR> awaitFrame(int timeoutMs);
+
+    // The frame last returned by awaitFrame, including the application state
+    const FollowerFrame& lastFrame() const { return m_frame; }
+    const Stats& stats() const { return m_stats; }
+
+private:
+    inline bool decode();
+
+    RenderStream* m_rs;
+    std::unique_ptr<FollowerTransport> m_transport;
+    std::vector<uint8_t> m_message;
+    std::vector<ExternalEvent> m_events; // decoded before the message is known to be valid
+    FollowerFrame m_frame;
+    bool m_pending = false; // m_frame was received but not yet begun
+    Stats m_stats;
+};
+
+FollowerController::FollowerController(std::unique_ptr<FollowerTransport> transport)
+    : m_transport(std::move(transport))
+{
+}
+
+void FollowerController::publish(const FrameData& frame, const void* state, size_t size, const std::vector<ExternalEvent>& events)
+{
+    rs_detail::FollowerMessageHeader header = {};
+    header.magic = rs_detail::FOLLOWER_MESSAGE_MAGIC;
+    header.version = rs_detail::FOLLOWER_MESSAGE_VERSION;
+    header.sequence = ++m_sequence;
+    header.frame = frame;
+    header.stateSize = size;
+    header.eventCount = events.size();
+
+    m_message.resize(sizeof(header) + size);
+    if (size > 0)
+        memcpy(m_message.data() + sizeof(header), state, size);
+    rs_detail::writeExternalEvents(events, m_message);
+    header.publishTimeUs = rs_detail::wallClockMicroseconds();
+    memcpy(m_message.data(), &header, sizeof(header));
+    m_transport->send(m_message.data(), m_message.size());
+}
+
+Follower::Follower(RenderStream& rs, std::unique_ptr<FollowerTransport> transport)
+    : m_rs(&rs), m_transport(std::move(transport))
+{
+    m_rs->setFollower(true);
+}
+
+bool Follower::decode()
+{
+    rs_detail::FollowerMessageHeader header;
+    if (m_message.size() < sizeof(header))
+        return false;
+    memcpy(&header, m_message.data(), sizeof(header));
+    const uint8_t* state = m_message.data() + sizeof(header);
+    const size_t available = m_message.size() - sizeof(header);
+    if (header.magic != rs_detail::FOLLOWER_MESSAGE_MAGIC || header.version != rs_detail::FOLLOWER_MESSAGE_VERSION || header.stateSize > available ||
+        !rs_detail::readExternalEvents(state + header.stateSize, available - size_t(header.stateSize), header.eventCount, m_events))
+    {
+        RS_LOG("Ignoring malformed follower message");
+        return false;
+    }
+
+    if (m_frame.sequence != 0 && header.sequence > m_frame.sequence + 1)
+        m_stats.dropped += header.sequence - m_frame.sequence - 1;
+    m_frame.sequence = header.sequence;
+    m_frame.frame = header.frame;
+    m_frame.state.assign(state, state + header.stateSize);
+    m_frame.events.swap(m_events);
+    m_frame.latencySeconds = double(rs_detail::wallClockMicroseconds() - header.publishTimeUs) * 1e-6;
+
+    ++m_stats.frames;
+    m_stats.lastLatencySeconds = m_frame.latencySeconds;
+    m_stats.maxLatencySeconds = std::max(m_stats.maxLatencySeconds, m_frame.latencySeconds);
+    m_stats.meanLatencySeconds += (m_frame.latencySeconds - m_stats.meanLatencySeconds) / double(m_stats.frames);
+    return true;
+}
+
+std::variant<FrameData, RS_ERROR> Follower::awaitFrame(int timeoutMs)
+{
+    if (!m_pending)
+    {
+        if (!m_transport->receive(m_message, timeoutMs) || !decode())
+            return RS_ERROR_TIMEOUT;
+        m_pending = true;
+    }
+
+    RS_ERROR err = m_rs->beginFollowerFrame(m_frame.frame.tTracked);
+    if (err == RS_ERROR_STREAMS_CHANGED)
+        return err; // still pending, begun again on the next call
+    m_pending = false;
+    if (err != RS_ERROR_SUCCESS)
+        return err;
+
+    if (m_frame.frame.flags & FRAMEDATA_RESET)
+        m_rs->invalidateParameterCache();
+    return m_frame.frame;
+}
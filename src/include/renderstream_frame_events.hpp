@@ -0,0 +1,224 @@
+#pragma once
+
+#include "renderstream_events.hpp"
+
+#include <deque>
+
+#ifndef RS_EXTERNAL_EVENT_MAX_SIZE
+#define RS_EXTERNAL_EVENT_MAX_SIZE 232 // makes an ExternalEvent 256 bytes
+#endif
+
+// An input from outside the cluster (OSC, MIDI, a network command...), stamped by the controller with the frame it
+// takes effect on.
+struct ExternalEvent
+{
+    double tTracked;
+    uint64_t sequence; // consecutive, assigned by the controller
+    uint32_t source; // application-defined
+    uint32_t size;
+    uint8_t data[RS_EXTERNAL_EVENT_MAX_SIZE];
+};
+
+// Applies external inputs on the same frame on every node of a cluster, so that they do not cause the simulations of the
+// nodes to diverge. Input handlers post events without taking locks; the controller stamps them with the frame it is
+// about to publish, and every node applies them when it reaches that frame.
+//
+// Each published message repeats the events of the last few frames, so a follower on a lossy transport such as
+// UdpFollowerTransport recovers the events of a dropped message from the next one. Recovered events are applied on the
+// frame they arrive with, which is later than on the other nodes; only longer gaps lose events.
+//
+// Controller:
+//     oscHandler = [&](const OscMessage& m) { events.post(SOURCE_OSC, m.data(), m.size()); };  // any thread
+//     ...
+//     auto result = rs.awaitFrameData(5000);
+//     const std::vector<ExternalEvent>& stamped = events.stamp(frameData);
+//     events.apply(frameData, [](const ExternalEvent& e) { ... });
+//     ... simulate ...
+//     controller.publish(frameData, state.data(), state.size(), stamped);
+//
+// Follower:
+//     auto result = follower.awaitFrame(5000);
+//     events.receive(follower.lastFrame().events);
+//     events.apply(frameData, [](const ExternalEvent& e) { ... });
+//     ... simulate ...
+class FrameEventQueue
+{
+public:
+    static const size_t DEFAULT_CAPACITY = 1024;
+    static const uint32_t DEFAULT_RESEND_FRAMES = 4;
+
+    struct Stats
+    {
+        uint64_t stamped = 0; // controller
+        uint64_t overflowed = 0; // posts that failed because too many events were waiting to be stamped
+        uint64_t applied = 0;
+        uint64_t late = 0; // applied after the frame they were stamped with, such as events recovered from a later message
+        uint64_t lost = 0; // follower: events published by the controller that were in none of the messages received
+    };
+
+    // (capacity) is the number of events that can be posted between frames. Events are published with (resendFrames)
+    // consecutive frames, so a follower loses them only if that many messages in a row are dropped.
+    explicit FrameEventQueue(size_t capacity = DEFAULT_CAPACITY, uint32_t resendFrames = DEFAULT_RESEND_FRAMES)
+        : m_incoming(capacity), m_resendFrames(std::max(resendFrames, 1u)) {}
+
+    // Controller, any thread. Returns false if (size) is larger than RS_EXTERNAL_EVENT_MAX_SIZE or the queue is full.
+    inline bool post(uint32_t source, const void* data, size_t size);
+
+    // Controller, frame thread. Stamps every event posted since the last call with (frame), queues them to be applied, and
+    // returns them for publishing to followers, after the events stamped by the previous (resendFrames - 1) calls. The
+    // result is valid until the next call.
+    inline const std::vector<ExternalEvent>& stamp(const FrameData& frame);
+
+    // Follower, frame thread. Queues events published by the controller. Events already received are ignored, so this
+    // may be called again for the same frame.
+    inline void receive(const std::vector<ExternalEvent>& events);
+
+    // Frame thread. Calls fn(const ExternalEvent&) for every queued event stamped with (frame) or an earlier frame, in the
+    // order they were posted, and returns the number of events. After a FRAMEDATA_RESET, every queued event is applied.
+    template <typename Fn>
+    size_t apply(const FrameData& frame, Fn&& fn);
+
+    inline Stats stats() const;
+
+private:
+    EventQueue<ExternalEvent> m_incoming;
+    uint32_t m_resendFrames;
+    std::vector<ExternalEvent> m_stamped; // the last (m_resendFrames) frames' events
+    std::deque<size_t> m_stampedCounts; // per frame, oldest first
+    std::vector<ExternalEvent> m_pending; // stamped, not yet applied
+    uint64_t m_sequence = 0; // of the next event
+    bool m_received = false; // follower
+    std::atomic<uint64_t> m_overflowed = { 0 };
+    Stats m_stats;
+};
+
+bool FrameEventQueue::post(uint32_t source, const void* data, size_t size)
+{
+    if (size > RS_EXTERNAL_EVENT_MAX_SIZE)
+        return false;
+
+    ExternalEvent event;
+    event.tTracked = 0;
+    event.sequence = 0;
+    event.source = source;
+    event.size = uint32_t(size);
+    if (size > 0)
+        memcpy(event.data, data, size);
+    if (m_incoming.push(event))
+        return true;
+    m_overflowed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+const std::vector<ExternalEvent>& FrameEventQueue::stamp(const FrameData& frame)
+{
+    if (m_stampedCounts.size() == m_resendFrames)
+    {
+        m_stamped.erase(m_stamped.begin(), m_stamped.begin() + m_stampedCounts.front());
+        m_stampedCounts.pop_front();
+    }
+
+    const size_t first = m_stamped.size();
+    m_incoming.drain([&](ExternalEvent& event) {
+        event.tTracked = frame.tTracked;
+        event.sequence = m_sequence++;
+        m_stamped.push_back(event);
+    });
+    m_stampedCounts.push_back(m_stamped.size() - first);
+    m_pending.insert(m_pending.end(), m_stamped.begin() + first, m_stamped.end());
+    m_stats.stamped += m_stamped.size() - first;
+    return m_stamped;
+}
+
+void FrameEventQueue::receive(const std::vector<ExternalEvent>& events)
+{
+    // A follower joining mid-show counts from the oldest event it is sent, not from the start of the show
+    if (!m_received && !events.empty())
+    {
+        m_received = true;
+        m_sequence = events.front().sequence;
+    }
+    for (const ExternalEvent& event : events)
+    {
+        if (event.sequence < m_sequence)
+            continue;
+        m_stats.lost += event.sequence - m_sequence;
+        m_sequence = event.sequence + 1;
+        m_pending.push_back(event);
+    }
+}
+
+template <typename Fn>
+size_t FrameEventQueue::apply(const FrameData& frame, Fn&& fn)
+{
+    const bool all = frame.flags & FRAMEDATA_RESET;
+    size_t nApplied = 0;
+    for (; nApplied < m_pending.size(); ++nApplied)
+    {
+        const ExternalEvent& event = m_pending[nApplied];
+        if (!all && event.tTracked > frame.tTracked)
+            break;
+        if (event.tTracked < frame.tTracked)
+            ++m_stats.late;
+        fn(event);
+    }
+    m_pending.erase(m_pending.begin(), m_pending.begin() + nApplied);
+    m_stats.applied += nApplied;
+    return nApplied;
+}
+
+FrameEventQueue::Stats FrameEventQueue::stats() const
+{
+    Stats stats = m_stats;
+    stats.overflowed = m_overflowed.load(std::memory_order_relaxed);
+    return stats;
+}
+
+namespace rs_detail
+{
+    // Events are sent with only (size) bytes of data
+    struct ExternalEventHeader
+    {
+        double tTracked;
+        uint64_t sequence;
+        uint32_t source;
+        uint32_t size;
+    };
+
+    inline void writeExternalEvents(const std::vector<ExternalEvent>& events, std::vector<uint8_t>& out)
+    {
+        for (const ExternalEvent& event : events)
+        {
+            const ExternalEventHeader header = { event.tTracked, event.sequence, event.source, event.size };
+            const size_t pos = out.size();
+            out.resize(pos + sizeof(header) + event.size);
+            memcpy(out.data() + pos, &header, sizeof(header));
+            memcpy(out.data() + pos + sizeof(header), event.data, event.size);
+        }
+    }
+
+    // Returns false if (data) does not hold exactly (count) events
+    inline bool readExternalEvents(const uint8_t* data, size_t size, uint64_t count, std::vector<ExternalEvent>& events)
+    {
+        if (count > size / sizeof(ExternalEventHeader))
+            return false;
+        events.resize(size_t(count));
+        for (ExternalEvent& event : events)
+        {
+            ExternalEventHeader header;
+            if (size < sizeof(header))
+                return false;
+            memcpy(&header, data, sizeof(header));
+            if (header.size > RS_EXTERNAL_EVENT_MAX_SIZE || size - sizeof(header) < header.size)
+                return false;
+            event.tTracked = header.tTracked;
+            event.sequence = header.sequence;
+            event.source = header.source;
+            event.size = header.size;
+            memcpy(event.data, data + sizeof(header), header.size);
+            data += sizeof(header) + header.size;
+            size -= sizeof(header) + header.size;
+        }
+        return size == 0;
+    }
+}
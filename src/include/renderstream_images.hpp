@@ -0,0 +1,463 @@
+#pragma once
+
+#include "renderstream.hpp"
+#include "renderstream_memory.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Host memory copy of an image parameter.
+struct HostImage
+{
+    int64_t imageId = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    RSPixelFormat format = RS_FMT_INVALID;
+    uint32_t stride = 0;
+    const uint8_t* data = nullptr;
+};
+
+// Keeps image parameters in host memory, keyed by imageId, so unchanged images are only fetched once.
+// Parameters are bound by scene and key, so one cache can be shared by scenes which use the same keys.
+// Images which are no longer bound to any parameter are released with rs_releaseImage2 and their buffers kept for reuse.
+class ImageParameterCache
+{
+public:
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+
+        double hitRate() const { return hits + misses ? double(hits) / double(hits + misses) : 0.0; }
+    };
+
+    inline explicit ImageParameterCache(RenderStream& rs, uint32_t strideAlignment = RS_HOST_BUFFER_ALIGNMENT, size_t maxPooledBuffers = 4);
+    inline ~ImageParameterCache();
+
+    ImageParameterCache(const ImageParameterCache&) = delete;
+    ImageParameterCache& operator=(const ImageParameterCache&) = delete;
+
+    // Returns the host memory copy of (image), bound to the parameter (key) of the scene (schemaHash). Only fetches if no
+    // cached copy of image.imageId exists.
+    inline const HostImage& get(uint64_t schemaHash, const std::string& key, const ImageFrameData& image);
+    const HostImage& get(const std::string& key, const ImageFrameData& image) { return get(0, key, image); }
+    inline const HostImage& get(ParameterValues& values, const std::string& key);
+
+    // Unbinds the parameter (key) of the scene (schemaHash), releasing its image if nothing else references it.
+    inline void evict(uint64_t schemaHash, const std::string& key);
+    void evict(const std::string& key) { evict(0, key); }
+    inline void clear();
+
+    const Stats& stats() const { return m_stats; }
+
+private:
+    struct Entry
+    {
+        HostImage image;
+        HostBuffer buffer;
+        SenderFrame frame;
+        uint32_t refs = 0;
+    };
+
+    inline void unbind(int64_t imageId);
+    inline HostBuffer acquireBuffer(size_t size);
+
+    RenderStream* m_rs;
+    uint32_t m_strideAlignment;
+    size_t m_maxPooledBuffers;
+    std::unordered_map<int64_t, Entry> m_entries;
+    std::map<std::pair<uint64_t, std::string>, int64_t> m_bindings; // (scene hash, parameter key) -> imageId
+    std::vector<HostBuffer> m_pool;
+    Stats m_stats;
+};
+
+ImageParameterCache::ImageParameterCache(RenderStream& rs, uint32_t strideAlignment, size_t maxPooledBuffers)
+    : m_rs(&rs), m_strideAlignment(strideAlignment), m_maxPooledBuffers(maxPooledBuffers)
+{
+}
+
+ImageParameterCache::~ImageParameterCache()
+{
+    try
+    {
+        clear();
+    }
+    catch (const std::exception& e)
+    {
+        RS_LOG("Failed to release cached images: " << e.what());
+    }
+}
+
+const HostImage& ImageParameterCache::get(uint64_t schemaHash, const std::string& key, const ImageFrameData& image)
+{
+    auto binding = m_bindings.find(std::make_pair(schemaHash, key));
+    if (binding != m_bindings.end() && binding->second == image.imageId)
+    {
+        ++m_stats.hits;
+        return m_entries.at(image.imageId).image;
+    }
+
+    auto it = m_entries.find(image.imageId);
+    if (it != m_entries.end())
+    {
+        ++m_stats.hits;
+    }
+    else
+    {
+        ++m_stats.misses;
+
+        Entry entry;
+        entry.image.imageId = image.imageId;
+        entry.image.width = image.width;
+        entry.image.height = image.height;
+        entry.image.format = image.format;
+        entry.image.stride = rsAlignedStride(image.width, image.format, m_strideAlignment);
+        entry.buffer = acquireBuffer(size_t(entry.image.stride) * image.height);
+        entry.image.data = entry.buffer.data();
+
+        entry.frame.type = RS_FRAMETYPE_HOST_MEMORY;
+        entry.frame.cpu.data = entry.buffer.data();
+        entry.frame.cpu.stride = entry.image.stride;
+        entry.frame.cpu.format = image.format;
+        m_rs->getFrameImage(image.imageId, entry.frame);
+
+        it = m_entries.emplace(image.imageId, std::move(entry)).first;
+    }
+
+    // Bind before unbinding the old image, in case both keys referenced the same entry
+    ++it->second.refs;
+    if (binding != m_bindings.end())
+    {
+        const int64_t previous = binding->second;
+        binding->second = image.imageId;
+        unbind(previous);
+    }
+    else
+    {
+        m_bindings.emplace(std::make_pair(schemaHash, key), image.imageId);
+    }
+
+    return it->second.image;
+}
+
+const HostImage& ImageParameterCache::get(ParameterValues& values, const std::string& key)
+{
+    return get(values.scene().hash, key, values.get<ImageFrameData>(key));
+}
+
+void ImageParameterCache::evict(uint64_t schemaHash, const std::string& key)
+{
+    auto binding = m_bindings.find(std::make_pair(schemaHash, key));
+    if (binding == m_bindings.end())
+        return;
+
+    const int64_t imageId = binding->second;
+    m_bindings.erase(binding);
+    unbind(imageId);
+}
+
+void ImageParameterCache::clear()
+{
+    m_bindings.clear();
+    for (auto& [imageId, entry] : m_entries)
+    {
+        ++m_stats.evictions;
+        m_rs->releaseImage(entry.frame);
+    }
+    m_entries.clear();
+    m_pool.clear();
+}
+
+void ImageParameterCache::unbind(int64_t imageId)
+{
+    auto it = m_entries.find(imageId);
+    if (it == m_entries.end() || --it->second.refs > 0)
+        return;
+
+    ++m_stats.evictions;
+    m_rs->releaseImage(it->second.frame);
+    if (m_pool.size() < m_maxPooledBuffers)
+        m_pool.push_back(std::move(it->second.buffer));
+    m_entries.erase(it);
+}
+
+HostBuffer ImageParameterCache::acquireBuffer(size_t size)
+{
+    // Best fit from the pool, so that small images don't hold on to large buffers
+    auto best = m_pool.end();
+    for (auto it = m_pool.begin(); it != m_pool.end(); ++it)
+    {
+        if (it->size() >= size && (best == m_pool.end() || it->size() < best->size()))
+            best = it;
+    }
+
+    if (best == m_pool.end())
+        return HostBuffer(size);
+
+    HostBuffer out = std::move(*best);
+    m_pool.erase(best);
+    return out;
+}
+
+// Fixed set of worker threads running queued tasks in submission order.
+class TaskPool
+{
+public:
+    inline explicit TaskPool(size_t nThreads);
+    inline ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    template <typename Fn>
+    std::shared_future<void> submit(Fn&& fn);
+
+private:
+    inline void run();
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<std::function<void()>> m_tasks;
+    bool m_quit = false;
+};
+
+TaskPool::TaskPool(size_t nThreads)
+{
+    for (size_t i = 0; i < nThreads; ++i)
+        m_threads.emplace_back([this] { run(); });
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& thread : m_threads)
+        thread.join();
+}
+
+template <typename Fn>
+std::shared_future<void> TaskPool::submit(Fn&& fn)
+{
+    auto task = std::make_shared<std::packaged_task<void()>>(std::forward<Fn>(fn));
+    std::shared_future<void> out = task->get_future().share();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.emplace_back([task] { (*task)(); });
+    }
+    m_wake.notify_one();
+    return out;
+}
+
+void TaskPool::run()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_quit || !m_tasks.empty(); });
+            // Drain remaining tasks before quitting, so no future is left unsatisfied
+            if (m_tasks.empty())
+                return;
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+// Fetches every image parameter of a scene on background threads, as soon as a frame arrives, so that rs_getFrameImage2
+// is off the frame thread. Each parameter has two host memory buffers: the image returned for the previous frame stays
+// valid while the next one is being fetched.
+//
+// RenderStream calls are not documented as thread-safe, so the workers make them one at a time, and every fetch must
+// have finished before the frame thread calls into the dll again: call end() before the next awaitFrameData.
+//
+// Usage:
+//     ParameterValues values = rs.getFrameParameters(scene);
+//     prefetcher.begin(values);
+//     ...
+//     const HostImage& image = prefetcher.wait("image_key"); // blocks on this image only
+//     ...
+//     prefetcher.end();
+//     rs.awaitFrameData(...);
+class ImagePrefetcher
+{
+public:
+    struct Stats
+    {
+        uint64_t hits = 0; // image unchanged since the previous frame, no fetch needed
+        uint64_t misses = 0;
+        double blockedSeconds = 0; // time spent in wait() for fetches to complete
+    };
+
+    inline explicit ImagePrefetcher(RenderStream& rs, size_t nThreads = 2, uint32_t strideAlignment = RS_HOST_BUFFER_ALIGNMENT);
+    inline ~ImagePrefetcher();
+
+    ImagePrefetcher(const ImagePrefetcher&) = delete;
+    ImagePrefetcher& operator=(const ImagePrefetcher&) = delete;
+
+    // Starts fetching all changed image parameters of the scene. Call immediately after awaitFrameData.
+    inline void begin(ParameterValues& values);
+    // Blocks until the image parameter (key) of the current frame is available. Valid until the next-but-one call to begin.
+    inline const HostImage& wait(const std::string& key);
+    // Blocks until every fetch started by begin has finished. Call before awaitFrameData or any other RenderStream call.
+    // Fetch errors are still reported by wait.
+    inline void end();
+
+    const Stats& stats() const { return m_stats; }
+
+private:
+    struct Slot
+    {
+        HostBuffer buffers[2];
+        SenderFrame frames[2];
+        HostImage images[2];
+        bool held[2] = { false, false };
+        int current = 0;
+        std::shared_future<void> pending;
+    };
+
+    inline void fetch(Slot& slot, int target, const ImageFrameData& image);
+
+    RenderStream* m_rs;
+    uint32_t m_strideAlignment;
+    std::unordered_map<std::string, Slot> m_slots; // keyed by parameter key
+    Stats m_stats;
+    std::mutex m_rsMutex; // serialises the workers' RenderStream calls
+    TaskPool m_pool; // destroyed first, so no task outlives the slots
+};
+
+ImagePrefetcher::ImagePrefetcher(RenderStream& rs, size_t nThreads, uint32_t strideAlignment)
+    : m_rs(&rs), m_strideAlignment(strideAlignment), m_pool(nThreads)
+{
+}
+
+ImagePrefetcher::~ImagePrefetcher()
+{
+    for (auto& [key, slot] : m_slots)
+    {
+        if (slot.pending.valid())
+            slot.pending.wait();
+        for (int i = 0; i < 2; ++i)
+        {
+            if (!slot.held[i])
+                continue;
+            try
+            {
+                m_rs->releaseImage(slot.frames[i]);
+            }
+            catch (const std::exception& e)
+            {
+                RS_LOG("Failed to release prefetched image: " << e.what());
+            }
+        }
+    }
+}
+
+void ImagePrefetcher::begin(ParameterValues& values)
+{
+    // The previous frame's fetches must complete before their buffers can be reused
+    end();
+    for (auto& [key, slot] : m_slots)
+        slot.pending = std::shared_future<void>();
+
+    const RemoteParameters& scene = values.scene();
+    for (uint32_t iParam = 0; iParam < scene.nParameters; ++iParam)
+    {
+        const RemoteParameter& param = scene.parameters[iParam];
+        if (param.type != RS_PARAMETER_IMAGE || (param.flags & REMOTEPARAMETER_READ_ONLY))
+            continue;
+
+        const ImageFrameData image = values.get<ImageFrameData>(param.key);
+        Slot& slot = m_slots[param.key];
+        if (slot.held[slot.current] && slot.images[slot.current].imageId == image.imageId)
+        {
+            ++m_stats.hits;
+            continue;
+        }
+
+        ++m_stats.misses;
+        // Keep the previous frame's image intact by fetching into the other buffer
+        if (slot.held[slot.current])
+            slot.current = 1 - slot.current;
+        const int target = slot.current;
+        slot.pending = m_pool.submit([this, &slot, target, image] { fetch(slot, target, image); });
+    }
+}
+
+const HostImage& ImagePrefetcher::wait(const std::string& key)
+{
+    auto it = m_slots.find(key);
+    if (it == m_slots.end())
+        throw std::runtime_error("Image parameter was not prefetched");
+
+    Slot& slot = it->second;
+    if (slot.pending.valid())
+    {
+        const auto start = std::chrono::steady_clock::now();
+        slot.pending.get(); // rethrows fetch errors
+        m_stats.blockedSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    if (!slot.held[slot.current])
+        throw std::runtime_error("Image parameter fetch failed");
+
+    return slot.images[slot.current];
+}
+
+void ImagePrefetcher::end()
+{
+    for (auto& [key, slot] : m_slots)
+    {
+        if (slot.pending.valid())
+            slot.pending.wait();
+    }
+}
+
+void ImagePrefetcher::fetch(Slot& slot, int target, const ImageFrameData& image)
+{
+    if (slot.held[target])
+    {
+        std::lock_guard<std::mutex> lock(m_rsMutex);
+        m_rs->releaseImage(slot.frames[target]);
+        slot.held[target] = false;
+    }
+
+    // Allocation runs concurrently, only the dll calls are serialised
+    const uint32_t stride = rsAlignedStride(image.width, image.format, m_strideAlignment);
+    const size_t size = size_t(stride) * image.height;
+    if (slot.buffers[target].size() < size)
+        slot.buffers[target] = HostBuffer(size);
+
+    SenderFrame& frame = slot.frames[target];
+    frame.type = RS_FRAMETYPE_HOST_MEMORY;
+    frame.cpu.data = slot.buffers[target].data();
+    frame.cpu.stride = stride;
+    frame.cpu.format = image.format;
+    {
+        std::lock_guard<std::mutex> lock(m_rsMutex);
+        m_rs->getFrameImage(image.imageId, frame);
+    }
+
+    HostImage& out = slot.images[target];
+    out.imageId = image.imageId;
+    out.width = image.width;
+    out.height = image.height;
+    out.format = image.format;
+    out.stride = stride;
+    out.data = slot.buffers[target].data();
+    slot.held[target] = true;
+}
@@ -0,0 +1,332 @@
+#pragma once
+
+#include "renderstream.hpp"
+#include "renderstream_math.hpp"
+
+#include <cmath>
+
+namespace rs_detail
+{
+    // out[i] = a[i] * (1 - t) + b[i] * t
+    inline void lerpFloats(const float* a, const float* b, float t, float* out, size_t n)
+    {
+        size_t i = 0;
+#if defined(__AVX2__)
+        const __m256 wa = _mm256_set1_ps(1.f - t), wb = _mm256_set1_ps(t);
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(a + i), wa), _mm256_mul_ps(_mm256_loadu_ps(b + i), wb)));
+#endif
+        for (; i < n; ++i)
+            out[i] = a[i] * (1.f - t) + b[i] * t;
+    }
+
+    // out[i] = a[i] * wa[i] + b[i] * wb[i]
+    inline void blendFloats(const float* a, const float* wa, const float* b, const float* wb, float* out, size_t n)
+    {
+        size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(wa + i)), _mm256_mul_ps(_mm256_loadu_ps(b + i), _mm256_loadu_ps(wb + i))));
+#endif
+        for (; i < n; ++i)
+            out[i] = a[i] * wa[i] + b[i] * wb[i];
+    }
+}
+
+// Keeps the last few float blocks of a scene (see ParameterValues::floats) and evaluates them at any time between frames.
+// Numbers are interpolated linearly. Poses and transforms are decomposed when pushed, and interpolated with a linear
+// translation and scale and a slerped rotation. Times outside the history hold the oldest or newest value.
+//
+// Each parameter can also be smoothed with a first order low-pass filter, applied after interpolation.
+// Evaluation is O(floats + transforms) regardless of history length, and does not allocate once warmed up.
+//
+// Usage:
+//     ParameterInterpolator interpolator(scene);
+//     interpolator.setSmoothing("camera_height", 0.1f);
+//     ...
+//     interpolator.push(frameData.tTracked, rs.getFrameParameters(scene));  // once per frame
+//     for (double t = ...; t < next; t += 1.0 / 240)
+//         simulate(interpolator.evaluate(t));
+class ParameterInterpolator
+{
+public:
+    static const size_t DEFAULT_HISTORY = 4;
+
+    inline explicit ParameterInterpolator(const RemoteParameters& scene, size_t history = DEFAULT_HISTORY);
+
+    // Adds the values of the frame requested at (tTracked). A time earlier than the newest sample, e.g. after
+    // FRAMEDATA_RESET, clears the history and the smoothing state.
+    inline void push(double tTracked, const ParameterValues& values);
+    inline void reset();
+
+    // Low-pass filters the parameter (key) with a time constant of (seconds). 0 disables smoothing.
+    inline void setSmoothing(const std::string& key, float seconds);
+
+    // The float block of the scene at time (t). Valid until the next call to evaluate.
+    inline const std::vector<float>& evaluate(double t);
+
+    // Index of the first float of the number, pose or transform parameter (key) in the float block
+    inline uint32_t offset(const std::string& key) const;
+
+    size_t size() const { return m_count; }
+
+private:
+    struct Entry
+    {
+        uint32_t offset;
+        int32_t iMatrix; // -1 for numbers
+    };
+
+    struct Sample
+    {
+        double t = 0;
+        std::vector<float> floats;
+        TRSArrays trs;
+    };
+
+    const Sample& sample(size_t age) const { return m_samples[(m_head + m_samples.size() - 1 - age) % m_samples.size()]; }
+    inline void interpolateMatrices(const Sample& a, const Sample& b, float alpha);
+    inline void smoothMatrices(float dt);
+
+    uint64_t m_schemaHash;
+    std::unordered_map<std::string, Entry> m_entries;
+    std::vector<uint32_t> m_matrixOffsets;
+    std::vector<float> m_timeConstants; // per float
+    std::vector<float> m_matrixTimeConstants; // per pose or transform
+    bool m_smoothing = false;
+
+    std::vector<Sample> m_samples; // ring buffer
+    size_t m_head = 0; // next sample to write
+    size_t m_count = 0;
+
+    std::vector<float> m_target; // interpolated, before smoothing
+    std::vector<float> m_out;
+    std::vector<float> m_weights[2];
+    TRSArrays m_targetTRS, m_outTRS;
+    AffineArrays m_affine;
+    TransformArrays m_composeScratch;
+    double m_lastT = 0;
+    bool m_hasOut = false;
+};
+
+ParameterInterpolator::ParameterInterpolator(const RemoteParameters& scene, size_t history)
+    : m_schemaHash(scene.hash)
+{
+    uint32_t nFloats = 0;
+    for (uint32_t iParam = 0; iParam < scene.nParameters; ++iParam)
+    {
+        const RemoteParameter& param = scene.parameters[iParam];
+        if (param.flags & REMOTEPARAMETER_READ_ONLY)
+            continue;
+
+        const uint32_t count = rsParameterFloatCount(param.type);
+        if (count == 0)
+            continue;
+        const bool isMatrix = param.type != RS_PARAMETER_NUMBER;
+        m_entries.emplace(param.key, Entry{ nFloats, isMatrix ? int32_t(m_matrixOffsets.size()) : -1 });
+        if (isMatrix)
+            m_matrixOffsets.push_back(nFloats);
+        nFloats += count;
+    }
+
+    m_timeConstants.assign(nFloats, 0.f);
+    m_matrixTimeConstants.assign(m_matrixOffsets.size(), 0.f);
+    m_samples.resize(std::max<size_t>(history, 2));
+    for (Sample& s : m_samples)
+    {
+        s.floats.resize(nFloats);
+        s.trs.resize(m_matrixOffsets.size());
+    }
+    m_target.resize(nFloats);
+    m_out.resize(nFloats);
+    for (std::vector<float>& w : m_weights)
+        w.resize(m_matrixOffsets.size());
+    m_targetTRS.resize(m_matrixOffsets.size());
+    m_outTRS.resize(m_matrixOffsets.size());
+    m_affine.resize(m_matrixOffsets.size());
+}
+
+void ParameterInterpolator::push(double tTracked, const ParameterValues& values)
+{
+    if (values.scene().hash != m_schemaHash)
+        throw std::runtime_error("Parameter values are for a different scene");
+    const std::vector<float>& floats = values.floats();
+    if (floats.size() != m_out.size())
+        throw std::runtime_error("Float block does not match scene");
+
+    if (m_count > 0)
+    {
+        const double newest = sample(0).t;
+        if (tTracked < newest)
+            reset();
+        else if (tTracked == newest)
+        {
+            // Replace the newest sample
+            m_head = (m_head + m_samples.size() - 1) % m_samples.size();
+            --m_count;
+        }
+    }
+
+    Sample& s = m_samples[m_head];
+    s.t = tTracked;
+    std::copy(floats.begin(), floats.end(), s.floats.begin());
+    for (size_t i = 0; i < m_matrixOffsets.size(); ++i)
+        m_affine.set(i, &floats[m_matrixOffsets[i]]);
+    rsDecomposeAffine(m_affine, s.trs);
+
+    m_head = (m_head + 1) % m_samples.size();
+    m_count = std::min(m_count + 1, m_samples.size());
+}
+
+void ParameterInterpolator::reset()
+{
+    m_count = 0;
+    m_hasOut = false;
+}
+
+void ParameterInterpolator::setSmoothing(const std::string& key, float seconds)
+{
+    auto it = m_entries.find(key);
+    if (it == m_entries.end())
+        throw std::runtime_error("Unknown key");
+
+    if (it->second.iMatrix < 0)
+        m_timeConstants[it->second.offset] = std::max(0.f, seconds);
+    else
+        m_matrixTimeConstants[it->second.iMatrix] = std::max(0.f, seconds);
+
+    m_smoothing = std::any_of(m_timeConstants.begin(), m_timeConstants.end(), [](float s) { return s > 0.f; })
+        || std::any_of(m_matrixTimeConstants.begin(), m_matrixTimeConstants.end(), [](float s) { return s > 0.f; });
+}
+
+uint32_t ParameterInterpolator::offset(const std::string& key) const
+{
+    auto it = m_entries.find(key);
+    if (it == m_entries.end())
+        throw std::runtime_error("Unknown key");
+    return it->second.offset;
+}
+
+const std::vector<float>& ParameterInterpolator::evaluate(double t)
+{
+    if (m_count == 0)
+        throw std::runtime_error("No parameter history");
+
+    // Find the newest sample at or before t, and the sample after it
+    size_t age = 0;
+    while (age + 1 < m_count && sample(age).t > t)
+        ++age;
+    const Sample& a = sample(age);
+    const Sample& b = age > 0 ? sample(age - 1) : a;
+    const float alpha = b.t > a.t ? float(std::max(0.0, std::min(1.0, (t - a.t) / (b.t - a.t)))) : 0.f;
+
+    // Matrix floats are lerped too, then overwritten below
+    rs_detail::lerpFloats(a.floats.data(), b.floats.data(), alpha, m_target.data(), m_target.size());
+    interpolateMatrices(a, b, alpha);
+
+    const float dt = float(t - m_lastT);
+    if (!m_hasOut || !m_smoothing || dt < 0.f)
+    {
+        std::copy(m_target.begin(), m_target.end(), m_out.begin());
+        m_outTRS = m_targetTRS;
+    }
+    else if (dt > 0.f)
+    {
+        // First order low-pass: out += (target - out) * dt / (timeConstant + dt)
+        size_t i = 0;
+        const size_t n = m_out.size();
+#if defined(__AVX2__)
+        const __m256 dt8 = _mm256_set1_ps(dt);
+        const __m256 one = _mm256_set1_ps(1.f);
+        for (; i + 8 <= n; i += 8)
+        {
+            const __m256 k = _mm256_div_ps(dt8, _mm256_add_ps(_mm256_loadu_ps(&m_timeConstants[i]), dt8));
+            const __m256 v = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&m_out[i]), _mm256_sub_ps(one, k)), _mm256_mul_ps(_mm256_loadu_ps(&m_target[i]), k));
+            _mm256_storeu_ps(&m_out[i], v);
+        }
+#endif
+        for (; i < n; ++i)
+        {
+            const float k = dt / (m_timeConstants[i] + dt);
+            m_out[i] = m_out[i] * (1.f - k) + m_target[i] * k;
+        }
+        smoothMatrices(dt);
+    }
+    m_lastT = t;
+    m_hasOut = true;
+
+    if (!m_matrixOffsets.empty())
+    {
+        rsComposeTRS(m_outTRS, m_affine, m_composeScratch);
+        for (size_t i = 0; i < m_matrixOffsets.size(); ++i)
+            m_affine.get(i, &m_out[m_matrixOffsets[i]]);
+    }
+    return m_out;
+}
+
+void ParameterInterpolator::interpolateMatrices(const Sample& a, const Sample& b, float alpha)
+{
+    const size_t n = m_matrixOffsets.size();
+    if (n == 0)
+        return;
+
+    // Slerp weights, normalised so that the blended quaternion is unit length
+    std::vector<float>& wa = m_weights[0];
+    std::vector<float>& wb = m_weights[1];
+    for (size_t i = 0; i < n; ++i)
+    {
+        const float dot = a.trs.rx[i] * b.trs.rx[i] + a.trs.ry[i] * b.trs.ry[i] + a.trs.rz[i] * b.trs.rz[i] + a.trs.rw[i] * b.trs.rw[i];
+        const float cosTheta = std::min(1.f, std::fabs(dot));
+        float w0 = 1.f - alpha, w1 = alpha;
+        if (cosTheta < 0.9995f)
+        {
+            const float theta = std::acos(cosTheta);
+            const float invSin = 1.f / std::sin(theta);
+            w0 = std::sin(w0 * theta) * invSin;
+            w1 = std::sin(w1 * theta) * invSin;
+        }
+        const float len = std::sqrt(w0 * w0 + w1 * w1 + 2.f * w0 * w1 * cosTheta);
+        wa[i] = w0 / len;
+        wb[i] = std::copysign(w1 / len, dot); // take the shorter arc
+    }
+
+    rs_detail::blendFloats(a.trs.rx.data(), wa.data(), b.trs.rx.data(), wb.data(), m_targetTRS.rx.data(), n);
+    rs_detail::blendFloats(a.trs.ry.data(), wa.data(), b.trs.ry.data(), wb.data(), m_targetTRS.ry.data(), n);
+    rs_detail::blendFloats(a.trs.rz.data(), wa.data(), b.trs.rz.data(), wb.data(), m_targetTRS.rz.data(), n);
+    rs_detail::blendFloats(a.trs.rw.data(), wa.data(), b.trs.rw.data(), wb.data(), m_targetTRS.rw.data(), n);
+    rs_detail::lerpFloats(a.trs.x.data(), b.trs.x.data(), alpha, m_targetTRS.x.data(), n);
+    rs_detail::lerpFloats(a.trs.y.data(), b.trs.y.data(), alpha, m_targetTRS.y.data(), n);
+    rs_detail::lerpFloats(a.trs.z.data(), b.trs.z.data(), alpha, m_targetTRS.z.data(), n);
+    rs_detail::lerpFloats(a.trs.sx.data(), b.trs.sx.data(), alpha, m_targetTRS.sx.data(), n);
+    rs_detail::lerpFloats(a.trs.sy.data(), b.trs.sy.data(), alpha, m_targetTRS.sy.data(), n);
+    rs_detail::lerpFloats(a.trs.sz.data(), b.trs.sz.data(), alpha, m_targetTRS.sz.data(), n);
+}
+
+void ParameterInterpolator::smoothMatrices(float dt)
+{
+    TRSArrays& out = m_outTRS;
+    const TRSArrays& target = m_targetTRS;
+    for (size_t i = 0; i < m_matrixOffsets.size(); ++i)
+    {
+        const float k = dt / (m_matrixTimeConstants[i] + dt);
+        const float dot = out.rx[i] * target.rx[i] + out.ry[i] * target.ry[i] + out.rz[i] * target.rz[i] + out.rw[i] * target.rw[i];
+        const float kq = std::copysign(k, dot);
+
+        float q[4] = {
+            out.rx[i] * (1.f - k) + target.rx[i] * kq,
+            out.ry[i] * (1.f - k) + target.ry[i] * kq,
+            out.rz[i] * (1.f - k) + target.rz[i] * kq,
+            out.rw[i] * (1.f - k) + target.rw[i] * kq,
+        };
+        const float len = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+        const float invLen = len > 0.f ? 1.f / len : 0.f;
+        out.rx[i] = q[0] * invLen; out.ry[i] = q[1] * invLen; out.rz[i] = q[2] * invLen; out.rw[i] = q[3] * invLen;
+
+        out.x[i] = out.x[i] * (1.f - k) + target.x[i] * k;
+        out.y[i] = out.y[i] * (1.f - k) + target.y[i] * k;
+        out.z[i] = out.z[i] * (1.f - k) + target.z[i] * k;
+        out.sx[i] = out.sx[i] * (1.f - k) + target.sx[i] * k;
+        out.sy[i] = out.sy[i] * (1.f - k) + target.sy[i] * k;
+        out.sz[i] = out.sz[i] * (1.f - k) + target.sz[i] * k;
+    }
+}
@@ -0,0 +1,316 @@
+#pragma once
+
+#include "renderstream.hpp"
+
+#include <cmath>
+
+// Matrices follow the layout of RS_PARAMETER_POSE and RS_PARAMETER_TRANSFORM values: 16 floats, row-major, row-vector
+// convention (v' = v * M), with the translation in elements 12-14. Parent-relative transforms compose as local * parent.
+
+// Translation + unit quaternion per element, in structure-of-arrays form. Mirrors the Transform struct.
+struct TransformArrays
+{
+    std::vector<float> x, y, z;
+    std::vector<float> rx, ry, rz, rw;
+
+    void resize(size_t n)
+    {
+        for (std::vector<float>* v : { &x, &y, &z, &rx, &ry, &rz, &rw })
+            v->resize(n);
+    }
+    size_t size() const { return x.size(); }
+
+    void set(size_t i, const Transform& t)
+    {
+        x[i] = t.x; y[i] = t.y; z[i] = t.z;
+        rx[i] = t.rx; ry[i] = t.ry; rz[i] = t.rz; rw[i] = t.rw;
+    }
+};
+
+// Affine matrices in structure-of-arrays form: m[0..8] is the upper 3x3 (row-major), m[9..11] the translation row.
+struct AffineArrays
+{
+    std::vector<float> m[12];
+
+    void resize(size_t n)
+    {
+        for (std::vector<float>& v : m)
+            v.resize(n);
+    }
+    size_t size() const { return m[0].size(); }
+
+    void set(size_t i, const float matrix[16])
+    {
+        for (size_t k = 0; k < 12; ++k)
+            m[k][i] = matrix[(k / 3) * 4 + k % 3];
+    }
+    void get(size_t i, float matrix[16]) const
+    {
+        for (size_t row = 0; row < 4; ++row)
+        {
+            for (size_t col = 0; col < 3; ++col)
+                matrix[row * 4 + col] = m[row * 3 + col][i];
+            matrix[row * 4 + 3] = row == 3 ? 1.f : 0.f;
+        }
+    }
+};
+
+inline void rsTransformToMatrix(const Transform& t, float out[16])
+{
+    const float x2 = t.rx + t.rx, y2 = t.ry + t.ry, z2 = t.rz + t.rz;
+    const float xx = t.rx * x2, yy = t.ry * y2, zz = t.rz * z2;
+    const float xy = t.rx * y2, xz = t.rx * z2, yz = t.ry * z2;
+    const float wx = t.rw * x2, wy = t.rw * y2, wz = t.rw * z2;
+    const float m[16] = {
+        1.f - (yy + zz), xy + wz, xz - wy, 0.f,
+        xy - wz, 1.f - (xx + zz), yz + wx, 0.f,
+        xz + wy, yz - wx, 1.f - (xx + yy), 0.f,
+        t.x, t.y, t.z, 1.f
+    };
+    std::copy(m, m + 16, out);
+}
+
+// Converts every transform in (in) to an affine matrix in (out), 8 at a time with AVX2.
+inline void rsTransformsToAffine(const TransformArrays& in, AffineArrays& out)
+{
+    const size_t n = in.size();
+    out.resize(n);
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256 one = _mm256_set1_ps(1.f);
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(&in.rx[i]), y = _mm256_loadu_ps(&in.ry[i]), z = _mm256_loadu_ps(&in.rz[i]), w = _mm256_loadu_ps(&in.rw[i]);
+        const __m256 x2 = _mm256_add_ps(x, x), y2 = _mm256_add_ps(y, y), z2 = _mm256_add_ps(z, z);
+        const __m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+        const __m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+        const __m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+        _mm256_storeu_ps(&out.m[0][i], _mm256_sub_ps(one, _mm256_add_ps(yy, zz)));
+        _mm256_storeu_ps(&out.m[1][i], _mm256_add_ps(xy, wz));
+        _mm256_storeu_ps(&out.m[2][i], _mm256_sub_ps(xz, wy));
+        _mm256_storeu_ps(&out.m[3][i], _mm256_sub_ps(xy, wz));
+        _mm256_storeu_ps(&out.m[4][i], _mm256_sub_ps(one, _mm256_add_ps(xx, zz)));
+        _mm256_storeu_ps(&out.m[5][i], _mm256_add_ps(yz, wx));
+        _mm256_storeu_ps(&out.m[6][i], _mm256_add_ps(xz, wy));
+        _mm256_storeu_ps(&out.m[7][i], _mm256_sub_ps(yz, wx));
+        _mm256_storeu_ps(&out.m[8][i], _mm256_sub_ps(one, _mm256_add_ps(xx, yy)));
+        _mm256_storeu_ps(&out.m[9][i], _mm256_loadu_ps(&in.x[i]));
+        _mm256_storeu_ps(&out.m[10][i], _mm256_loadu_ps(&in.y[i]));
+        _mm256_storeu_ps(&out.m[11][i], _mm256_loadu_ps(&in.z[i]));
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        const Transform t = { in.x[i], in.y[i], in.z[i], in.rx[i], in.ry[i], in.rz[i], in.rw[i] };
+        float matrix[16];
+        rsTransformToMatrix(t, matrix);
+        out.set(i, matrix);
+    }
+}
+
+// out[i] = a[i] * b[j], where j = bIndex[i]. (out) must not alias (a). Used for parent-relative composition.
+inline void rsMultiplyAffineGather(const AffineArrays& a, const AffineArrays& b, const int32_t* bIndex, size_t first, size_t last, AffineArrays& out)
+{
+    size_t i = first;
+#if defined(__AVX2__)
+    for (; i + 8 <= last; i += 8)
+    {
+        const __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bIndex + i));
+        __m256 l[12], p[12];
+        for (size_t k = 0; k < 12; ++k)
+        {
+            l[k] = _mm256_loadu_ps(&a.m[k][i]);
+            p[k] = _mm256_i32gather_ps(b.m[k].data(), idx, 4);
+        }
+        for (size_t row = 0; row < 4; ++row)
+        {
+            for (size_t col = 0; col < 3; ++col)
+            {
+                __m256 v = _mm256_mul_ps(l[row * 3 + 0], p[0 + col]);
+                v = _mm256_add_ps(v, _mm256_mul_ps(l[row * 3 + 1], p[3 + col]));
+                v = _mm256_add_ps(v, _mm256_mul_ps(l[row * 3 + 2], p[6 + col]));
+                if (row == 3)
+                    v = _mm256_add_ps(v, p[9 + col]);
+                _mm256_storeu_ps(&out.m[row * 3 + col][i], v);
+            }
+        }
+    }
+#endif
+    for (; i < last; ++i)
+    {
+        const size_t j = size_t(bIndex[i]);
+        for (size_t row = 0; row < 4; ++row)
+        {
+            for (size_t col = 0; col < 3; ++col)
+            {
+                float v = a.m[row * 3 + 0][i] * b.m[0 + col][j] + a.m[row * 3 + 1][i] * b.m[3 + col][j] + a.m[row * 3 + 2][i] * b.m[6 + col][j];
+                if (row == 3)
+                    v += b.m[9 + col][j];
+                out.m[row * 3 + col][i] = v;
+            }
+        }
+    }
+}
+
+// Translation, unit quaternion and scale per element, in structure-of-arrays form.
+struct TRSArrays
+{
+    std::vector<float> x, y, z;
+    std::vector<float> rx, ry, rz, rw;
+    std::vector<float> sx, sy, sz;
+
+    void resize(size_t n)
+    {
+        for (std::vector<float>* v : { &x, &y, &z, &rx, &ry, &rz, &rw, &sx, &sy, &sz })
+            v->resize(n);
+    }
+    size_t size() const { return x.size(); }
+};
+
+namespace rs_detail
+{
+    // Decomposes the affine matrix (m) (as in AffineArrays) into out[10] = { x, y, z, rx, ry, rz, rw, sx, sy, sz }. Assumes no shear.
+    inline void decomposeAffine(const float m[12], float out[10])
+    {
+        float r[9];
+        float s[3];
+        for (size_t row = 0; row < 3; ++row)
+        {
+            s[row] = std::sqrt(m[row * 3] * m[row * 3] + m[row * 3 + 1] * m[row * 3 + 1] + m[row * 3 + 2] * m[row * 3 + 2]);
+            const float inv = s[row] > 0.f ? 1.f / s[row] : 0.f;
+            for (size_t col = 0; col < 3; ++col)
+                r[row * 3 + col] = m[row * 3 + col] * inv;
+        }
+        // A reflection is represented as a negative x scale
+        const float det = r[0] * (r[4] * r[8] - r[5] * r[7]) - r[1] * (r[3] * r[8] - r[5] * r[6]) + r[2] * (r[3] * r[7] - r[4] * r[6]);
+        if (det < 0.f)
+        {
+            s[0] = -s[0];
+            r[0] = -r[0]; r[1] = -r[1]; r[2] = -r[2];
+        }
+
+        float qw = 0.5f * std::sqrt(std::max(0.f, 1.f + r[0] + r[4] + r[8]));
+        float qx = std::copysign(0.5f * std::sqrt(std::max(0.f, 1.f + r[0] - r[4] - r[8])), r[5] - r[7]);
+        float qy = std::copysign(0.5f * std::sqrt(std::max(0.f, 1.f - r[0] + r[4] - r[8])), r[6] - r[2]);
+        float qz = std::copysign(0.5f * std::sqrt(std::max(0.f, 1.f - r[0] - r[4] + r[8])), r[1] - r[3]);
+        const float len = std::sqrt(qx * qx + qy * qy + qz * qz + qw * qw);
+        const float invLen = len > 0.f ? 1.f / len : 0.f;
+
+        const float result[10] = { m[9], m[10], m[11], qx * invLen, qy * invLen, qz * invLen, qw * invLen, s[0], s[1], s[2] };
+        std::copy(result, result + 10, out);
+    }
+
+#if defined(__AVX2__)
+    inline __m256 copySign(__m256 magnitude, __m256 sign)
+    {
+        const __m256 signMask = _mm256_set1_ps(-0.f);
+        return _mm256_or_ps(_mm256_andnot_ps(signMask, magnitude), _mm256_and_ps(signMask, sign));
+    }
+
+    inline __m256 safeReciprocal(__m256 v)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        return _mm256_and_ps(_mm256_div_ps(_mm256_set1_ps(1.f), v), _mm256_cmp_ps(v, zero, _CMP_GT_OQ));
+    }
+#endif
+}
+
+// Decomposes every matrix in (in) into translation, rotation and scale, 8 at a time with AVX2. Assumes no shear.
+inline void rsDecomposeAffine(const AffineArrays& in, TRSArrays& out)
+{
+    const size_t n = in.size();
+    out.resize(n);
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 r[9], s[3];
+        for (size_t row = 0; row < 3; ++row)
+        {
+            const __m256 a = _mm256_loadu_ps(&in.m[row * 3][i]), b = _mm256_loadu_ps(&in.m[row * 3 + 1][i]), c = _mm256_loadu_ps(&in.m[row * 3 + 2][i]);
+            s[row] = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b)), _mm256_mul_ps(c, c)));
+            const __m256 inv = rs_detail::safeReciprocal(s[row]);
+            r[row * 3] = _mm256_mul_ps(a, inv);
+            r[row * 3 + 1] = _mm256_mul_ps(b, inv);
+            r[row * 3 + 2] = _mm256_mul_ps(c, inv);
+        }
+
+        const __m256 det = _mm256_add_ps(_mm256_sub_ps(
+            _mm256_mul_ps(r[0], _mm256_sub_ps(_mm256_mul_ps(r[4], r[8]), _mm256_mul_ps(r[5], r[7]))),
+            _mm256_mul_ps(r[1], _mm256_sub_ps(_mm256_mul_ps(r[3], r[8]), _mm256_mul_ps(r[5], r[6])))),
+            _mm256_mul_ps(r[2], _mm256_sub_ps(_mm256_mul_ps(r[3], r[7]), _mm256_mul_ps(r[4], r[6]))));
+        const __m256 flip = _mm256_and_ps(_mm256_cmp_ps(det, zero, _CMP_LT_OQ), _mm256_set1_ps(-0.f));
+        s[0] = _mm256_xor_ps(s[0], flip);
+        r[0] = _mm256_xor_ps(r[0], flip);
+        r[1] = _mm256_xor_ps(r[1], flip);
+        r[2] = _mm256_xor_ps(r[2], flip);
+
+        __m256 qw = _mm256_mul_ps(half, _mm256_sqrt_ps(_mm256_max_ps(zero, _mm256_add_ps(one, _mm256_add_ps(r[0], _mm256_add_ps(r[4], r[8]))))));
+        __m256 qx = _mm256_mul_ps(half, _mm256_sqrt_ps(_mm256_max_ps(zero, _mm256_sub_ps(_mm256_add_ps(one, r[0]), _mm256_add_ps(r[4], r[8])))));
+        __m256 qy = _mm256_mul_ps(half, _mm256_sqrt_ps(_mm256_max_ps(zero, _mm256_sub_ps(_mm256_add_ps(one, r[4]), _mm256_add_ps(r[0], r[8])))));
+        __m256 qz = _mm256_mul_ps(half, _mm256_sqrt_ps(_mm256_max_ps(zero, _mm256_sub_ps(_mm256_add_ps(one, r[8]), _mm256_add_ps(r[0], r[4])))));
+        qx = rs_detail::copySign(qx, _mm256_sub_ps(r[5], r[7]));
+        qy = rs_detail::copySign(qy, _mm256_sub_ps(r[6], r[2]));
+        qz = rs_detail::copySign(qz, _mm256_sub_ps(r[1], r[3]));
+        const __m256 invLen = rs_detail::safeReciprocal(_mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(qx, qx), _mm256_mul_ps(qy, qy)), _mm256_add_ps(_mm256_mul_ps(qz, qz), _mm256_mul_ps(qw, qw)))));
+
+        _mm256_storeu_ps(&out.x[i], _mm256_loadu_ps(&in.m[9][i]));
+        _mm256_storeu_ps(&out.y[i], _mm256_loadu_ps(&in.m[10][i]));
+        _mm256_storeu_ps(&out.z[i], _mm256_loadu_ps(&in.m[11][i]));
+        _mm256_storeu_ps(&out.rx[i], _mm256_mul_ps(qx, invLen));
+        _mm256_storeu_ps(&out.ry[i], _mm256_mul_ps(qy, invLen));
+        _mm256_storeu_ps(&out.rz[i], _mm256_mul_ps(qz, invLen));
+        _mm256_storeu_ps(&out.rw[i], _mm256_mul_ps(qw, invLen));
+        _mm256_storeu_ps(&out.sx[i], s[0]);
+        _mm256_storeu_ps(&out.sy[i], s[1]);
+        _mm256_storeu_ps(&out.sz[i], s[2]);
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        float m[12], trs[10];
+        for (size_t k = 0; k < 12; ++k)
+            m[k] = in.m[k][i];
+        rs_detail::decomposeAffine(m, trs);
+        out.x[i] = trs[0]; out.y[i] = trs[1]; out.z[i] = trs[2];
+        out.rx[i] = trs[3]; out.ry[i] = trs[4]; out.rz[i] = trs[5]; out.rw[i] = trs[6];
+        out.sx[i] = trs[7]; out.sy[i] = trs[8]; out.sz[i] = trs[9];
+    }
+}
+
+// Inverse of rsDecomposeAffine. (scratch) holds the translations and rotations, and can be reused between calls so that
+// composing does not allocate.
+inline void rsComposeTRS(const TRSArrays& in, AffineArrays& out, TransformArrays& scratch)
+{
+    TransformArrays& tr = scratch;
+    tr.x = in.x; tr.y = in.y; tr.z = in.z;
+    tr.rx = in.rx; tr.ry = in.ry; tr.rz = in.rz; tr.rw = in.rw;
+    rsTransformsToAffine(tr, out);
+
+    const std::vector<float>* scales[3] = { &in.sx, &in.sy, &in.sz };
+    const size_t n = in.size();
+    for (size_t row = 0; row < 3; ++row)
+    {
+        for (size_t col = 0; col < 3; ++col)
+        {
+            float* m = out.m[row * 3 + col].data();
+            const float* s = scales[row]->data();
+            size_t i = 0;
+#if defined(__AVX2__)
+            for (; i + 8 <= n; i += 8)
+                _mm256_storeu_ps(m + i, _mm256_mul_ps(_mm256_loadu_ps(m + i), _mm256_loadu_ps(s + i)));
+#endif
+            for (; i < n; ++i)
+                m[i] *= s[i];
+        }
+    }
+}
+
+inline void rsComposeTRS(const TRSArrays& in, AffineArrays& out)
+{
+    TransformArrays scratch;
+    rsComposeTRS(in, out, scratch);
+}
@@ -0,0 +1,483 @@
+#pragma once
+
+#include "renderstream.hpp"
+
+#include <malloc.h>
+#include <atomic>
+#include <list>
+#include <mutex>
+
+// Default alignment of host memory frame buffers and their rows.
+#define RS_HOST_BUFFER_ALIGNMENT 256
+
+inline uint32_t rsAlignedStride(uint32_t width, RSPixelFormat format, uint32_t alignment = RS_HOST_BUFFER_ALIGNMENT)
+{
+    const uint32_t stride = width * rsBytesPerPixel(format);
+    return (stride + alignment - 1) / alignment * alignment;
+}
+
+#define RS_NUMA_NODE_ANY -1
+#define RS_NUMA_NODE_CURRENT -2 // the node of the processor running the allocating thread
+
+// How host memory frame buffers are allocated. The default policy uses the CRT heap; any other option allocates the
+// buffer directly from the OS with VirtualAlloc, so that the first frames after a stream change don't take page faults.
+struct HostMemoryPolicy
+{
+    // Back buffers with large pages, which are always resident. Requires SeLockMemoryPrivilege to be held and enabled,
+    // otherwise buffers fall back to normal pages.
+    bool largePages = false;
+    // Touch every page at allocation time
+    bool prefault = false;
+    // Lock buffers into the working set with VirtualLock, growing the minimum working set to fit while they are allocated
+    bool lock = false;
+    // Allocate from this NUMA node, RS_NUMA_NODE_ANY or RS_NUMA_NODE_CURRENT
+    int32_t numaNode = RS_NUMA_NODE_ANY;
+
+    bool usesVirtualAlloc() const { return largePages || prefault || lock || numaNode != RS_NUMA_NODE_ANY; }
+};
+
+// Process-wide counters for buffers allocated with a HostMemoryPolicy.
+struct HostMemoryStats
+{
+    std::atomic<uint64_t> faultsAvoided = { 0 }; // pages which would otherwise have faulted on first use
+    std::atomic<uint64_t> largePageBytes = { 0 }; // currently allocated
+    std::atomic<uint64_t> largePageFallbacks = { 0 };
+    std::atomic<uint64_t> lockedBytes = { 0 }; // currently allocated
+    std::atomic<uint64_t> lockFailures = { 0 };
+};
+
+inline HostMemoryStats& rsHostMemoryStats()
+{
+    static HostMemoryStats stats;
+    return stats;
+}
+
+// Owning, aligned block of host memory for RS_FRAMETYPE_HOST_MEMORY frames.
+class HostBuffer
+{
+public:
+    HostBuffer() = default;
+    inline explicit HostBuffer(size_t size, size_t alignment = RS_HOST_BUFFER_ALIGNMENT);
+    // Page aligned
+    inline HostBuffer(size_t size, const HostMemoryPolicy& policy);
+    inline ~HostBuffer();
+
+    HostBuffer(const HostBuffer&) = delete;
+    HostBuffer& operator=(const HostBuffer&) = delete;
+    inline HostBuffer(HostBuffer&& other) noexcept;
+    inline HostBuffer& operator=(HostBuffer&& other) noexcept;
+
+    uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_virtual = false; // allocated with VirtualAlloc
+    size_t m_largePageBytes = 0;
+    size_t m_lockedBytes = 0;
+    size_t m_workingSetBytes = 0; // added to the minimum working set for this buffer
+};
+
+namespace rs_detail
+{
+    // Grows or shrinks the minimum working set of the process by (bytes)
+    inline bool adjustMinimumWorkingSet(int64_t bytes)
+    {
+        // Buffers are allocated and freed on any thread
+        static std::mutex mutex;
+        std::lock_guard<std::mutex> lock(mutex);
+        SIZE_T minimum = 0, maximum = 0;
+        if (!GetProcessWorkingSetSize(GetCurrentProcess(), &minimum, &maximum))
+            return false;
+        const SIZE_T target = bytes >= 0 ? minimum + SIZE_T(bytes) : minimum - std::min(minimum, SIZE_T(-bytes));
+        return SetProcessWorkingSetSize(GetCurrentProcess(), target, std::max(maximum, target)) != 0;
+    }
+}
+
+HostBuffer::HostBuffer(size_t size, size_t alignment)
+{
+    m_data = static_cast<uint8_t*>(_aligned_malloc(size, alignment));
+    if (!m_data)
+        throw std::bad_alloc();
+    m_size = size;
+}
+
+HostBuffer::HostBuffer(size_t size, const HostMemoryPolicy& policy)
+{
+    if (!policy.usesVirtualAlloc())
+    {
+        *this = HostBuffer(size);
+        return;
+    }
+
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    const size_t pageSize = info.dwPageSize;
+    HostMemoryStats& stats = rsHostMemoryStats();
+
+    DWORD numaNode = DWORD(policy.numaNode);
+    if (policy.numaNode == RS_NUMA_NODE_CURRENT)
+    {
+        PROCESSOR_NUMBER processor;
+        GetCurrentProcessorNumberEx(&processor);
+        USHORT node = 0;
+        numaNode = GetNumaProcessorNodeEx(&processor, &node) ? node : DWORD(RS_NUMA_NODE_ANY);
+    }
+    auto allocate = [&](size_t bytes, DWORD type) -> void* {
+        if (int32_t(numaNode) >= 0)
+            return VirtualAllocExNuma(GetCurrentProcess(), nullptr, bytes, type, PAGE_READWRITE, numaNode);
+        return VirtualAlloc(nullptr, bytes, type, PAGE_READWRITE);
+    };
+
+    const size_t largePageSize = policy.largePages ? GetLargePageMinimum() : 0;
+    if (largePageSize > 0)
+    {
+        const size_t bytes = (size + largePageSize - 1) / largePageSize * largePageSize;
+        m_data = static_cast<uint8_t*>(allocate(bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES));
+        if (m_data)
+        {
+            // Large pages are resident and locked as soon as they are allocated
+            m_size = size;
+            m_virtual = true;
+            m_largePageBytes = bytes;
+            stats.largePageBytes += bytes;
+            stats.faultsAvoided += (size + pageSize - 1) / pageSize;
+            return;
+        }
+        RS_LOG("Large page allocation of " << bytes << " bytes failed with error " << GetLastError() << ", using normal pages");
+        ++stats.largePageFallbacks;
+    }
+
+    m_data = static_cast<uint8_t*>(allocate(size, MEM_RESERVE | MEM_COMMIT));
+    if (!m_data)
+        throw std::bad_alloc();
+    m_size = size;
+    m_virtual = true;
+
+    if (policy.lock)
+    {
+        // VirtualLock fails once the locked pages would exceed the minimum working set. The destructor gives the
+        // growth back, so that reallocating buffers does not raise the minimum without bound.
+        if (rs_detail::adjustMinimumWorkingSet(int64_t(size)))
+            m_workingSetBytes = size;
+        if (VirtualLock(m_data, size))
+        {
+            // Locking makes every page resident
+            m_lockedBytes = size;
+            stats.lockedBytes += size;
+            stats.faultsAvoided += (size + pageSize - 1) / pageSize;
+            return;
+        }
+        RS_LOG("VirtualLock of " << size << " bytes failed with error " << GetLastError());
+        ++stats.lockFailures;
+        if (m_workingSetBytes > 0 && rs_detail::adjustMinimumWorkingSet(-int64_t(m_workingSetBytes)))
+            m_workingSetBytes = 0;
+    }
+
+    if (policy.prefault)
+    {
+        volatile uint8_t* bytes = m_data;
+        for (size_t offset = 0; offset < size; offset += pageSize)
+            bytes[offset] = 0;
+        stats.faultsAvoided += (size + pageSize - 1) / pageSize;
+    }
+}
+
+HostBuffer::~HostBuffer()
+{
+    if (!m_virtual)
+    {
+        _aligned_free(m_data);
+        return;
+    }
+
+    VirtualFree(m_data, 0, MEM_RELEASE);
+    HostMemoryStats& stats = rsHostMemoryStats();
+    stats.largePageBytes -= m_largePageBytes;
+    stats.lockedBytes -= m_lockedBytes;
+    if (m_workingSetBytes > 0)
+        rs_detail::adjustMinimumWorkingSet(-int64_t(m_workingSetBytes));
+}
+
+HostBuffer::HostBuffer(HostBuffer&& other) noexcept
+    : m_data(other.m_data), m_size(other.m_size), m_virtual(other.m_virtual),
+      m_largePageBytes(other.m_largePageBytes), m_lockedBytes(other.m_lockedBytes), m_workingSetBytes(other.m_workingSetBytes)
+{
+    other.m_data = nullptr;
+    other.m_size = 0;
+    other.m_virtual = false;
+    other.m_largePageBytes = 0;
+    other.m_lockedBytes = 0;
+    other.m_workingSetBytes = 0;
+}
+
+HostBuffer& HostBuffer::operator=(HostBuffer&& other) noexcept
+{
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+    std::swap(m_virtual, other.m_virtual);
+    std::swap(m_largePageBytes, other.m_largePageBytes);
+    std::swap(m_lockedBytes, other.m_lockedBytes);
+    std::swap(m_workingSetBytes, other.m_workingSetBytes);
+    return *this;
+}
+
+// Shape of a host memory frame buffer, used to match buffers in HostBufferPool.
+struct HostBufferKey
+{
+    uint32_t width;
+    uint32_t height;
+    RSPixelFormat format;
+    uint32_t stride;
+
+    bool operator==(const HostBufferKey& other) const
+    {
+        return width == other.width && height == other.height && format == other.format && stride == other.stride;
+    }
+    size_t size() const { return size_t(stride) * height; }
+};
+
+struct HostBufferKeyHash
+{
+    size_t operator()(const HostBufferKey& key) const
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (uint32_t v : { key.width, key.height, uint32_t(key.format), key.stride })
+            hash = (hash ^ v) * 1099511628211ull;
+        return size_t(hash);
+    }
+};
+
+class HostBufferPool;
+
+// A buffer borrowed from a HostBufferPool, returned to it on destruction.
+class PooledHostBuffer
+{
+public:
+    PooledHostBuffer() = default;
+    inline ~PooledHostBuffer();
+
+    PooledHostBuffer(const PooledHostBuffer&) = delete;
+    PooledHostBuffer& operator=(const PooledHostBuffer&) = delete;
+    inline PooledHostBuffer(PooledHostBuffer&& other) noexcept;
+    inline PooledHostBuffer& operator=(PooledHostBuffer&& other) noexcept;
+
+    uint8_t* data() const { return m_buffer.data(); }
+    uint32_t stride() const { return m_key.stride; }
+    const HostBufferKey& key() const { return m_key; }
+    explicit operator bool() const { return m_buffer.data() != nullptr; }
+
+    // Returns the buffer to its pool early
+    inline void reset();
+
+private:
+    friend class HostBufferPool;
+
+    HostBufferPool* m_pool = nullptr;
+    HostBufferKey m_key = {};
+    HostBuffer m_buffer;
+};
+
+// Thread-safe pool of host memory frame buffers, keyed by width, height, format and stride.
+// Released buffers are kept for reuse until the idle bytes exceed the cap, then the least recently released are freed.
+// The cap only bounds the memory the pool holds idle: borrowed buffers are not counted, and acquire never fails or
+// waits because of it.
+// When outputs are re-mapped, streams come back with new handles at the same resolutions and reuse the buffers of
+// the streams they replaced without allocating.
+class HostBufferPool
+{
+public:
+    static const size_t DEFAULT_MAX_IDLE_BYTES = size_t(1) << 30;
+
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t idleBytes = 0; // held by the pool
+        size_t residentBytes = 0; // held by the pool or borrowed from it
+
+        double hitRate() const { return hits + misses > 0 ? double(hits) / double(hits + misses) : 0.0; }
+    };
+
+    inline explicit HostBufferPool(size_t maxIdleBytes = DEFAULT_MAX_IDLE_BYTES);
+    inline ~HostBufferPool();
+
+    HostBufferPool(const HostBufferPool&) = delete;
+    HostBufferPool& operator=(const HostBufferPool&) = delete;
+
+    // The process-wide pool
+    static inline HostBufferPool& global();
+
+    // A buffer for a (width) x (height) frame in (format). A (stride) of 0 uses rsAlignedStride.
+    inline PooledHostBuffer acquire(uint32_t width, uint32_t height, RSPixelFormat format, uint32_t stride = 0);
+
+    // Caps the bytes of released buffers kept for reuse
+    inline void setMaxIdleBytes(size_t maxIdleBytes);
+    // Applies to buffers allocated after the call
+    inline void setPolicy(const HostMemoryPolicy& policy);
+    // Frees every idle buffer
+    inline void trim();
+
+    inline Stats stats() const;
+
+private:
+    friend class PooledHostBuffer;
+
+    struct Idle
+    {
+        HostBufferKey key;
+        HostBuffer buffer;
+    };
+    typedef std::list<Idle>::iterator IdleIterator;
+
+    inline void release(const HostBufferKey& key, HostBuffer&& buffer);
+    // Call with m_mutex held, and destroy (evicted) after releasing it, as freeing large buffers is slow
+    inline void evict(size_t maxIdleBytes, std::vector<HostBuffer>& evicted);
+
+    mutable std::mutex m_mutex;
+    size_t m_maxIdleBytes;
+    HostMemoryPolicy m_policy;
+    std::list<Idle> m_idle; // least recently released first
+    std::unordered_map<HostBufferKey, std::vector<IdleIterator>, HostBufferKeyHash> m_idleByKey; // oldest first
+    Stats m_stats;
+};
+
+PooledHostBuffer::~PooledHostBuffer()
+{
+    reset();
+}
+
+PooledHostBuffer::PooledHostBuffer(PooledHostBuffer&& other) noexcept
+    : m_pool(other.m_pool), m_key(other.m_key), m_buffer(std::move(other.m_buffer))
+{
+    other.m_pool = nullptr;
+}
+
+PooledHostBuffer& PooledHostBuffer::operator=(PooledHostBuffer&& other) noexcept
+{
+    if (this != &other)
+    {
+        reset();
+        m_pool = other.m_pool;
+        m_key = other.m_key;
+        m_buffer = std::move(other.m_buffer);
+        other.m_pool = nullptr;
+    }
+    return *this;
+}
+
+void PooledHostBuffer::reset()
+{
+    if (m_pool && m_buffer.data())
+        m_pool->release(m_key, std::move(m_buffer));
+    m_pool = nullptr;
+    m_buffer = HostBuffer();
+}
+
+HostBufferPool::HostBufferPool(size_t maxIdleBytes)
+    : m_maxIdleBytes(maxIdleBytes)
+{
+}
+
+HostBufferPool::~HostBufferPool()
+{
+    if (m_stats.residentBytes != m_stats.idleBytes)
+        RS_LOG("HostBufferPool destroyed with " << (m_stats.residentBytes - m_stats.idleBytes) << " bytes still borrowed");
+}
+
+HostBufferPool& HostBufferPool::global()
+{
+    static HostBufferPool pool;
+    return pool;
+}
+
+PooledHostBuffer HostBufferPool::acquire(uint32_t width, uint32_t height, RSPixelFormat format, uint32_t stride)
+{
+    PooledHostBuffer out;
+    out.m_pool = this;
+    out.m_key = { width, height, format, stride ? stride : rsAlignedStride(width, format) };
+    HostMemoryPolicy policy;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_idleByKey.find(out.m_key);
+        if (it != m_idleByKey.end())
+        {
+            // Most recently released first, as it is the most likely to still be in cache
+            const IdleIterator idle = it->second.back();
+            it->second.pop_back();
+            if (it->second.empty())
+                m_idleByKey.erase(it);
+            out.m_buffer = std::move(idle->buffer);
+            m_idle.erase(idle);
+            m_stats.idleBytes -= out.m_buffer.size();
+            ++m_stats.hits;
+            return out;
+        }
+        policy = m_policy;
+    }
+
+    // Allocate outside the lock, as prefaulting and locking large buffers is slow
+
+    out.m_buffer = HostBuffer(out.m_key.size(), policy);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_stats.misses;
+    m_stats.residentBytes += out.m_buffer.size();
+    return out;
+}
+
+void HostBufferPool::release(const HostBufferKey& key, HostBuffer&& buffer)
+{
+    std::vector<HostBuffer> evicted; // declared before the lock, so freed after it is released
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.idleBytes += buffer.size();
+    m_idle.push_back({ key, std::move(buffer) });
+    m_idleByKey[key].push_back(std::prev(m_idle.end()));
+    evict(m_maxIdleBytes, evicted);
+}
+
+void HostBufferPool::evict(size_t maxIdleBytes, std::vector<HostBuffer>& evicted)
+{
+    while (m_stats.idleBytes > maxIdleBytes && !m_idle.empty())
+    {
+        Idle& oldest = m_idle.front();
+        auto it = m_idleByKey.find(oldest.key);
+        it->second.erase(it->second.begin());
+        if (it->second.empty())
+            m_idleByKey.erase(it);
+        m_stats.idleBytes -= oldest.buffer.size();
+        m_stats.residentBytes -= oldest.buffer.size();
+        ++m_stats.evictions;
+        evicted.push_back(std::move(oldest.buffer));
+        m_idle.pop_front();
+    }
+}
+
+void HostBufferPool::setMaxIdleBytes(size_t maxIdleBytes)
+{
+    std::vector<HostBuffer> evicted;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxIdleBytes = maxIdleBytes;
+    evict(m_maxIdleBytes, evicted);
+}
+
+void HostBufferPool::setPolicy(const HostMemoryPolicy& policy)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_policy = policy;
+}
+
+void HostBufferPool::trim()
+{
+    std::vector<HostBuffer> evicted;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    evict(0, evicted);
+}
+
+HostBufferPool::Stats HostBufferPool::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
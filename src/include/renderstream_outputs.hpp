@@ -0,0 +1,168 @@
+#pragma once
+
+#include "renderstream.hpp"
+
+// Packs the read-only parameters of a scene into FrameResponseData.
+// Read-only numbers, poses and transforms share a float block in schema order, and read-only text parameters a text block.
+// The same buffers back the response of every stream in a frame.
+//
+// Usage:
+//     OutputParameterWriter outputs(scene);  // after setSchema
+//     const OutputParameterWriter::Handle strobe = outputs.handle("strobe_ro");
+//     ...
+//     outputs.set(strobe, value);
+//     for (each stream)
+//         rs.sendFrame(stream, frame, outputs.response(&cameraData));
+class OutputParameterWriter
+{
+public:
+    typedef uint32_t Handle;
+
+    inline explicit OutputParameterWriter(const RemoteParameters& scene);
+
+    inline Handle handle(const std::string& key) const;
+
+    inline void set(Handle handle, float value);
+    inline void set(const std::string& key, float value) { set(handle(key), value); }
+    // The 16 floats of a pose or transform
+    inline void setMatrix(Handle handle, const float matrix[16]);
+    inline void setMatrix(const std::string& key, const float matrix[16]) { setMatrix(handle(key), matrix); }
+    // (text) is copied
+    inline void setText(Handle handle, const char* text);
+    inline void setText(const std::string& key, const char* text) { setText(handle(key), text); }
+
+    // When enabled, outputs are only sent on frames where they have changed, and an empty response is sent otherwise.
+    // Only enable this if the d3 version in use keeps the last received outputs. Disabled by default.
+    void setSkipUnchanged(bool skip) { m_skipUnchanged = skip; }
+
+    // Response for a stream of the current frame. A new frame starts whenever (camera)->tTracked changes.
+    inline FrameResponseData response(const CameraResponseData* camera);
+
+private:
+    struct Output
+    {
+        RemoteParameterType type;
+        uint32_t index; // into the float or text block
+    };
+
+    uint64_t m_schemaHash;
+    std::unordered_map<std::string, Handle> m_handles;
+    std::vector<Output> m_outputs;
+
+    std::vector<float> m_floats;
+    std::vector<std::string> m_texts;
+    std::vector<const char*> m_textPointers; // rebuilt by response(), so that copies never point into another writer
+
+    bool m_skipUnchanged = false;
+    bool m_dirty = true;
+    bool m_sendThisFrame = true;
+    double m_tTracked = -1;
+};
+
+OutputParameterWriter::OutputParameterWriter(const RemoteParameters& scene)
+    : m_schemaHash(scene.hash)
+{
+    uint32_t nFloats = 0, nTexts = 0;
+    for (uint32_t iParam = 0; iParam < scene.nParameters; ++iParam)
+    {
+        const RemoteParameter& param = scene.parameters[iParam];
+        if (!(param.flags & REMOTEPARAMETER_READ_ONLY))
+            continue;
+
+        Output output = { param.type, 0 };
+        if (param.type == RS_PARAMETER_TEXT)
+        {
+            output.index = nTexts++;
+        }
+        else if (rsParameterFloatCount(param.type) > 0)
+        {
+            output.index = nFloats;
+            nFloats += rsParameterFloatCount(param.type);
+        }
+        else
+        {
+            RS_LOG("Read-only parameter '" << param.key << "' has an unsupported type for output");
+            continue;
+        }
+
+        m_handles.emplace(param.key, Handle(m_outputs.size()));
+        m_outputs.push_back(output);
+    }
+
+    // Outputs start at their defaults
+    m_floats.resize(nFloats);
+    for (uint32_t iParam = 0; iParam < scene.nParameters; ++iParam)
+    {
+        const RemoteParameter& param = scene.parameters[iParam];
+        auto it = m_handles.find(param.key);
+        if (it != m_handles.end() && param.type == RS_PARAMETER_NUMBER)
+            m_floats[m_outputs[it->second].index] = param.defaults.number.defaultValue;
+    }
+    m_texts.resize(nTexts);
+}
+
+OutputParameterWriter::Handle OutputParameterWriter::handle(const std::string& key) const
+{
+    auto it = m_handles.find(key);
+    if (it == m_handles.end())
+        throw std::runtime_error("Unknown key");
+    return it->second;
+}
+
+void OutputParameterWriter::set(Handle handle, float value)
+{
+    const Output& output = m_outputs.at(handle);
+    if (output.type != RS_PARAMETER_NUMBER)
+        throw std::runtime_error("Key is not a number");
+    float& current = m_floats[output.index];
+    m_dirty |= current != value;
+    current = value;
+}
+
+void OutputParameterWriter::setMatrix(Handle handle, const float matrix[16])
+{
+    const Output& output = m_outputs.at(handle);
+    if (output.type != RS_PARAMETER_POSE && output.type != RS_PARAMETER_TRANSFORM)
+        throw std::runtime_error("Key is not a transform or pose");
+    float* current = &m_floats[output.index];
+    m_dirty |= memcmp(current, matrix, 16 * sizeof(float)) != 0;
+    std::copy(matrix, matrix + 16, current);
+}
+
+void OutputParameterWriter::setText(Handle handle, const char* text)
+{
+    const Output& output = m_outputs.at(handle);
+    if (output.type != RS_PARAMETER_TEXT)
+        throw std::runtime_error("Key is not a text param");
+    std::string& current = m_texts[output.index];
+    if (current == text)
+        return;
+    current = text;
+    m_dirty = true;
+}
+
+FrameResponseData OutputParameterWriter::response(const CameraResponseData* camera)
+{
+    const double tTracked = camera ? camera->tTracked : 0;
+    if (tTracked != m_tTracked)
+    {
+        m_tTracked = tTracked;
+        m_sendThisFrame = m_dirty || !m_skipUnchanged;
+        m_dirty = false;
+    }
+
+    FrameResponseData response = {};
+    response.cameraData = camera;
+    response.schemaHash = m_schemaHash;
+    if (m_sendThisFrame)
+    {
+        response.parameterDataSize = uint32_t(m_floats.size() * sizeof(float));
+        response.parameterData = m_floats.data();
+        m_textPointers.resize(m_texts.size());
+        for (size_t i = 0; i < m_texts.size(); ++i)
+            m_textPointers[i] = m_texts[i].c_str();
+        response.textDataCount = uint32_t(m_textPointers.size());
+        response.textData = m_textPointers.data();
+    }
+    return response;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include "renderstream.hpp"
+
+#include <array>
+
+// Random numbers which are the same on every node of a cluster, without communication: each value is a pure function of
+// tTracked, a key chosen by the application (the scene, effect or stream), a draw and an index, computed with the
+// Philox4x32-10 counter-based generator. Use in place of rand() or time-seeded generators in procedural effects.
+//
+//     const FrameRandom random(frameData, rsHashString("sparks"));
+//     random.uniform(spawnX.data(), nSpawned, 0, 0);  // one value per spark
+//     random.uniform(spawnY.data(), nSpawned, 0, 1);  // independent of the draw above
+//     const float flicker = random.uniform(0, 2);
+//
+// Values do not depend on the order or batching in which they are generated, so different nodes may generate different
+// subsets of a stream.
+class FrameRandom
+{
+public:
+    inline FrameRandom(double tTracked, uint64_t key);
+    FrameRandom(const FrameData& frame, uint64_t key) : FrameRandom(frame.tTracked, key) {}
+
+    // Value (index) of the stream (draw)
+    inline uint32_t bits(uint64_t index, uint32_t draw = 0) const;
+    // In [0, 1), with 24 bits of precision
+    float uniform(uint64_t index, uint32_t draw = 0) const { return toUniform(bits(index, draw)); }
+
+    // Values (firstIndex) to (firstIndex + count) of the stream (draw), the same as calling the single value versions
+    inline void bits(uint32_t* out, size_t count, uint64_t firstIndex, uint32_t draw = 0) const;
+    inline void uniform(float* out, size_t count, uint64_t firstIndex, uint32_t draw = 0) const;
+
+private:
+    static float toUniform(uint32_t x) { return float(x >> 8) * (1.0f / 16777216.0f); }
+
+    std::array<uint32_t, 2> m_key;
+};
+
+namespace rs_detail
+{
+    static const uint32_t PHILOX_M0 = 0xD2511F53u;
+    static const uint32_t PHILOX_M1 = 0xCD9E8D57u;
+    static const uint32_t PHILOX_W0 = 0x9E3779B9u;
+    static const uint32_t PHILOX_W1 = 0xBB67AE85u;
+
+    inline std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> c, std::array<uint32_t, 2> k)
+    {
+        for (int round = 0; round < 10; ++round)
+        {
+            const uint64_t p0 = uint64_t(PHILOX_M0) * c[0];
+            const uint64_t p1 = uint64_t(PHILOX_M1) * c[2];
+            c = { uint32_t(p1 >> 32) ^ c[1] ^ k[0], uint32_t(p1), uint32_t(p0 >> 32) ^ c[3] ^ k[1], uint32_t(p0) };
+            k[0] += PHILOX_W0;
+            k[1] += PHILOX_W1;
+        }
+        return c;
+    }
+
+    // The 4 values of each block are (index / 4) of a stream
+    inline std::array<uint32_t, 4> philoxBlock(uint64_t block, uint32_t draw, std::array<uint32_t, 2> key)
+    {
+        return philox4x32({ uint32_t(block), uint32_t(block >> 32), draw, 0 }, key);
+    }
+
+    inline uint64_t mix64(uint64_t x)
+    {
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+#if defined(__AVX2__)
+    // 32x32->64 multiply of every 32-bit lane by (m)
+    inline void mulHiLo(__m256i a, __m256i m, __m256i& hi, __m256i& lo)
+    {
+        const __m256i even = _mm256_mul_epu32(a, m);
+        const __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+        lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+        hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+    }
+
+    // 8 consecutive blocks from (firstBlock), 32 values
+    inline void philoxBlocks8(uint32_t* out, uint64_t firstBlock, uint32_t draw, std::array<uint32_t, 2> key)
+    {
+        alignas(32) uint32_t lo[8], hi[8];
+        for (int i = 0; i < 8; ++i)
+        {
+            lo[i] = uint32_t(firstBlock + i);
+            hi[i] = uint32_t((firstBlock + i) >> 32);
+        }
+        __m256i c0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(lo));
+        __m256i c1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(hi));
+        __m256i c2 = _mm256_set1_epi32(int(draw));
+        __m256i c3 = _mm256_setzero_si256();
+        const __m256i m0 = _mm256_set1_epi32(int(PHILOX_M0));
+        const __m256i m1 = _mm256_set1_epi32(int(PHILOX_M1));
+        for (int round = 0; round < 10; ++round)
+        {
+            __m256i hi0, lo0, hi1, lo1;
+            mulHiLo(c0, m0, hi0, lo0);
+            mulHiLo(c2, m1, hi1, lo1);
+            c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32(int(key[0])));
+            c1 = lo1;
+            c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32(int(key[1])));
+            c3 = lo0;
+            key[0] += PHILOX_W0;
+            key[1] += PHILOX_W1;
+        }
+
+        // Transpose to block order
+        const __m256i t0 = _mm256_unpacklo_epi32(c0, c1);
+        const __m256i t1 = _mm256_unpackhi_epi32(c0, c1);
+        const __m256i t2 = _mm256_unpacklo_epi32(c2, c3);
+        const __m256i t3 = _mm256_unpackhi_epi32(c2, c3);
+        const __m256i u0 = _mm256_unpacklo_epi64(t0, t2); // blocks 0 and 4
+        const __m256i u1 = _mm256_unpackhi_epi64(t0, t2); // 1 and 5
+        const __m256i u2 = _mm256_unpacklo_epi64(t1, t3); // 2 and 6
+        const __m256i u3 = _mm256_unpackhi_epi64(t1, t3); // 3 and 7
+        __m256i* dst = reinterpret_cast<__m256i*>(out);
+        _mm256_storeu_si256(dst, _mm256_permute2x128_si256(u0, u1, 0x20));
+        _mm256_storeu_si256(dst + 1, _mm256_permute2x128_si256(u2, u3, 0x20));
+        _mm256_storeu_si256(dst + 2, _mm256_permute2x128_si256(u0, u1, 0x31));
+        _mm256_storeu_si256(dst + 3, _mm256_permute2x128_si256(u2, u3, 0x31));
+    }
+#endif
+}
+
+FrameRandom::FrameRandom(double tTracked, uint64_t key)
+{
+    uint64_t time;
+    memcpy(&time, &tTracked, sizeof(time));
+    const uint64_t seed = rs_detail::mix64(time ^ rs_detail::mix64(key));
+    m_key = { uint32_t(seed), uint32_t(seed >> 32) };
+}
+
+uint32_t FrameRandom::bits(uint64_t index, uint32_t draw) const
+{
+    return rs_detail::philoxBlock(index / 4, draw, m_key)[index % 4];
+}
+
+void FrameRandom::bits(uint32_t* out, size_t count, uint64_t firstIndex, uint32_t draw) const
+{
+    size_t i = 0;
+    // Up to the first whole block
+    for (; i < count && (firstIndex + i) % 4 != 0; ++i)
+        out[i] = bits(firstIndex + i, draw);
+
+#if defined(__AVX2__)
+    for (; i + 32 <= count; i += 32)
+        rs_detail::philoxBlocks8(out + i, (firstIndex + i) / 4, draw, m_key);
+#endif
+    for (; i + 4 <= count; i += 4)
+    {
+        const std::array<uint32_t, 4> block = rs_detail::philoxBlock((firstIndex + i) / 4, draw, m_key);
+        memcpy(out + i, block.data(), sizeof(block));
+    }
+    for (; i < count; ++i)
+        out[i] = bits(firstIndex + i, draw);
+}
+
+void FrameRandom::uniform(float* out, size_t count, uint64_t firstIndex, uint32_t draw) const
+{
+    const size_t CHUNK = 256;
+    uint32_t values[CHUNK];
+    for (size_t first = 0; first < count; first += CHUNK)
+    {
+        const size_t n = std::min(CHUNK, count - first);
+        bits(values, n, firstIndex + first, draw);
+        size_t i = 0;
+#if defined(__AVX2__)
+        const __m256 scale = _mm256_set1_ps(1.0f / 16777216.0f);
+        for (; i + 8 <= n; i += 8)
+        {
+            const __m256i x = _mm256_srli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i)), 8);
+            _mm256_storeu_ps(out + first + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale));
+        }
+#endif
+        for (; i < n; ++i)
+            out[first + i] = toUniform(values[i]);
+    }
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "renderstream.hpp"
+#include "renderstream_math.hpp"
+
+// Joint hierarchy of a skeleton layout, sorted by depth so that every joint comes after its parent.
+struct SkeletonTopology
+{
+    uint64_t layoutId = 0;
+    uint32_t version = 0;
+    std::vector<uint64_t> ids;
+    std::vector<int32_t> parents; // index of each joint's parent, or ids.size() for joints attached to the skeleton root
+    std::vector<uint32_t> levelStarts; // first joint of each depth level, followed by ids.size()
+    TransformArrays bindPose; // layout transforms, relative to the parent joint
+    std::unordered_map<uint64_t, uint32_t> indices; // joint id -> index
+
+    inline void build(uint64_t id, const SkeletonLayout& layout, size_t nJoints);
+    size_t size() const { return ids.size(); }
+};
+
+// A skeleton pose, with joints in topology order.
+struct SkeletonWorldPose
+{
+    const SkeletonTopology* topology = nullptr;
+    TransformArrays local; // relative to the parent joint, bind pose for joints missing from the pose
+    AffineArrays world; // world space matrices; element topology->size() holds the root transform
+
+    void worldMatrix(size_t iJoint, float out[16]) const { world.get(iJoint, out); }
+};
+
+// Computes world space matrices for every joint in (local), one depth level at a time with AVX2.
+// (localMatrices) is scratch storage, kept by the caller to avoid reallocating it every frame.
+inline void rsForwardKinematics(const SkeletonTopology& topology, const TransformArrays& local, const Transform& root, AffineArrays& localMatrices, AffineArrays& world);
+
+// Evaluates skeleton parameters, caching each layout's topology by layoutId and version.
+class SkeletonCache
+{
+public:
+    inline explicit SkeletonCache(RenderStream& rs);
+
+    // Fetches the pose of the skeleton parameter (key) for this frame and evaluates it to world space.
+    // Valid until the next call to evaluate for the same key.
+    inline const SkeletonWorldPose& evaluate(ParameterValues& values, const std::string& key);
+
+    inline const SkeletonTopology& layout(uint64_t schemaHash, uint32_t iSkeleton, uint64_t layoutId, uint32_t version);
+
+private:
+    RenderStream* m_rs;
+    std::unordered_map<uint64_t, SkeletonTopology> m_layouts; // keyed by layoutId
+    std::unordered_map<std::string, SkeletonWorldPose> m_poses; // keyed by parameter key
+    std::vector<SkeletonJointDesc> m_layoutJoints;
+    AffineArrays m_localMatrices;
+};
+
+void SkeletonTopology::build(uint64_t id, const SkeletonLayout& layout, size_t nJoints)
+{
+    layoutId = id;
+    version = layout.version;
+
+    std::unordered_map<uint64_t, uint32_t> source; // joint id -> index in layout
+    for (uint32_t i = 0; i < nJoints; ++i)
+    {
+        if (!source.emplace(layout.joints[i].id, i).second)
+            throw std::runtime_error("Duplicate joint id in skeleton layout");
+    }
+
+    // Joints whose parent is not in the layout are attached to the skeleton root
+    std::vector<uint32_t> depth(nJoints, UINT32_MAX);
+    std::vector<uint32_t> chain;
+    for (uint32_t i = 0; i < nJoints; ++i)
+    {
+        uint32_t joint = i;
+        while (depth[joint] == UINT32_MAX)
+        {
+            if (chain.size() > nJoints)
+                throw std::runtime_error("Cycle in skeleton layout");
+            chain.push_back(joint);
+            auto parent = source.find(layout.joints[joint].parentId);
+            if (parent == source.end())
+                break;
+            joint = parent->second;
+        }
+        uint32_t d = depth[joint] == UINT32_MAX ? 0 : depth[joint] + 1;
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+        {
+            if (depth[*it] == UINT32_MAX)
+                depth[*it] = d++;
+        }
+        chain.clear();
+    }
+
+    std::vector<uint32_t> order(nJoints);
+    for (uint32_t i = 0; i < nJoints; ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return depth[a] < depth[b]; });
+
+    ids.resize(nJoints);
+    parents.resize(nJoints);
+    bindPose.resize(nJoints);
+    indices.clear();
+    levelStarts.clear();
+    for (uint32_t i = 0; i < nJoints; ++i)
+    {
+        const SkeletonJointDesc& joint = layout.joints[order[i]];
+        ids[i] = joint.id;
+        bindPose.set(i, joint.transform);
+        indices.emplace(joint.id, i);
+        if (i == 0 || depth[order[i]] != depth[order[i - 1]])
+            levelStarts.push_back(i);
+    }
+    levelStarts.push_back(uint32_t(nJoints));
+
+    for (uint32_t i = 0; i < nJoints; ++i)
+    {
+        auto parent = indices.find(layout.joints[order[i]].parentId);
+        parents[i] = parent == indices.end() ? int32_t(nJoints) : int32_t(parent->second);
+    }
+}
+
+void rsForwardKinematics(const SkeletonTopology& topology, const TransformArrays& local, const Transform& root, AffineArrays& localMatrices, AffineArrays& world)
+{
+    const size_t n = topology.size();
+    rsTransformsToAffine(local, localMatrices);
+
+    world.resize(n + 1);
+    float rootMatrix[16];
+    rsTransformToMatrix(root, rootMatrix);
+    world.set(n, rootMatrix);
+
+    // Joints within a level only depend on earlier levels, so each level can be processed in parallel
+    for (size_t level = 0; level + 1 < topology.levelStarts.size(); ++level)
+        rsMultiplyAffineGather(localMatrices, world, topology.parents.data(), topology.levelStarts[level], topology.levelStarts[level + 1], world);
+}
+
+SkeletonCache::SkeletonCache(RenderStream& rs)
+    : m_rs(&rs)
+{
+}
+
+const SkeletonWorldPose& SkeletonCache::evaluate(ParameterValues& values, const std::string& key)
+{
+    const SkeletonPose pose = values.get<SkeletonPose>(key);
+    const size_t nPoseJoints = values.skeletonJointCount(key);
+    const SkeletonTopology& topology = layout(values.scene().hash, values.typeIndex(key), pose.layoutId, pose.layoutVersion);
+
+    SkeletonWorldPose& out = m_poses[key];
+    out.topology = &topology;
+    out.local = topology.bindPose;
+    for (size_t i = 0; i < nPoseJoints; ++i)
+    {
+        auto it = topology.indices.find(pose.joints[i].id);
+        if (it != topology.indices.end())
+            out.local.set(it->second, pose.joints[i].transform);
+    }
+
+    rsForwardKinematics(topology, out.local, pose.rootTransform, m_localMatrices, out.world);
+    return out;
+}
+
+const SkeletonTopology& SkeletonCache::layout(uint64_t schemaHash, uint32_t iSkeleton, uint64_t layoutId, uint32_t version)
+{
+    SkeletonTopology& topology = m_layouts[layoutId];
+    if (topology.ids.empty() || topology.version != version)
+    {
+        const SkeletonLayout layout = m_rs->getSkeletonLayout(schemaHash, iSkeleton, m_layoutJoints);
+        if (layout.version != version)
+            RS_LOG("Skeleton layout " << layoutId << " is version " << layout.version << ", pose expects " << version);
+        topology.build(layoutId, layout, m_layoutJoints.size());
+    }
+    return topology;
+}
@@ -0,0 +1,347 @@
+#pragma once
+
+#include "renderstream.hpp"
+
+#include <chrono>
+
+// Delta compression of application state for FollowerController::publish.
+// Each snapshot is XORed against the previous one, and the result run-length encoded as runs of unchanged and changed
+// 8-byte words, so the cost of a snapshot grows with how much of the state changed rather than its size.
+// A keyframe (a snapshot against all zeros) is sent at a fixed interval, and on request, so that followers that missed a
+// snapshot can resynchronise.
+//
+// Controller:
+//     SnapshotEncoder encoder;
+//     const std::vector<uint8_t>& snapshot = encoder.encode(state.data(), state.size());
+//     controller.publish(frameData, snapshot.data(), snapshot.size());
+//
+// Follower:
+//     SnapshotDecoder decoder;
+//     if (decoder.decode(follower.lastFrame().state.data(), follower.lastFrame().state.size()))
+//         ... use decoder.state() ...
+//     else
+//         ... missed a snapshot, skip frames until the next keyframe ...
+
+struct SnapshotStats
+{
+    uint64_t snapshots = 0;
+    uint64_t keyframes = 0;
+    uint64_t rawBytes = 0;
+    uint64_t encodedBytes = 0;
+    double lastRatio = 0; // raw / encoded size of the last snapshot
+    double lastSeconds = 0; // time to encode or decode the last snapshot
+
+    double ratio() const { return encodedBytes > 0 ? double(rawBytes) / double(encodedBytes) : 0; }
+};
+
+namespace rs_detail
+{
+    const uint32_t SNAPSHOT_MAGIC = 0x50535244; // "DRSP"
+    const uint32_t SNAPSHOT_KEYFRAME = 1;
+
+    struct SnapshotHeader
+    {
+        uint32_t magic;
+        uint32_t flags;
+        uint64_t sequence;
+        uint64_t baseSequence; // sequence this snapshot is a delta against, 0 for keyframes
+        uint64_t size;
+    };
+
+    inline uint8_t* writeVarint(uint8_t* out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            *out++ = uint8_t(value) | 0x80;
+            value >>= 7;
+        }
+        *out++ = uint8_t(value);
+        return out;
+    }
+
+    inline const uint8_t* readVarint(const uint8_t* in, const uint8_t* end, uint64_t& value)
+    {
+        value = 0;
+        for (uint32_t shift = 0; in < end && shift < 64; shift += 7)
+        {
+            const uint8_t byte = *in++;
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return in;
+        }
+        return nullptr;
+    }
+
+    inline uint64_t loadWord(const uint8_t* p)
+    {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        return word;
+    }
+
+    inline void storeWord(uint8_t* p, uint64_t word)
+    {
+        memcpy(p, &word, sizeof(word));
+    }
+
+    // Number of words from (first) to the next word of (current) that differs from (reference), up to (nWords)
+    inline size_t countEqualWords(const uint8_t* current, const uint8_t* reference, size_t first, size_t nWords)
+    {
+        size_t i = first;
+#if defined(__AVX2__)
+        for (; i + 4 <= nWords; i += 4)
+        {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current + i * 8));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(reference + i * 8));
+            const uint32_t equal = uint32_t(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(a, b))));
+            if (equal != 0xf)
+                return i - first + _tzcnt_u32(~equal);
+        }
+#endif
+        for (; i < nWords && loadWord(current + i * 8) == loadWord(reference + i * 8); ++i)
+            ;
+        return i - first;
+    }
+
+    // Number of words from (first) that differ from (reference), up to (nWords) or the next two consecutive equal words.
+    // A single equal word between changed words is included, as it costs less as a zero word than as a pair of run lengths.
+    inline size_t countChangedWords(const uint8_t* current, const uint8_t* reference, size_t first, size_t nWords)
+    {
+        size_t i = first;
+        while (i < nWords)
+        {
+#if defined(__AVX2__)
+            if (i + 4 <= nWords)
+            {
+                const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current + i * 8));
+                const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(reference + i * 8));
+                if (_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(a, b))) == 0)
+                {
+                    i += 4;
+                    continue;
+                }
+            }
+#endif
+            if (loadWord(current + i * 8) != loadWord(reference + i * 8))
+                ++i;
+            else if (i + 1 < nWords && loadWord(current + (i + 1) * 8) != loadWord(reference + (i + 1) * 8))
+                i += 2;
+            else
+                break;
+        }
+        return i - first;
+    }
+
+    // XORs (nWords) words of (in) into (out)
+    inline void xorWords(uint8_t* out, const uint8_t* in, size_t nWords)
+    {
+        size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 4 <= nWords; i += 4)
+        {
+            __m256i* dst = reinterpret_cast<__m256i*>(out + i * 8);
+            const __m256i src = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i * 8));
+            _mm256_storeu_si256(dst, _mm256_xor_si256(_mm256_loadu_si256(dst), src));
+        }
+#endif
+        for (; i < nWords; ++i)
+            storeWord(out + i * 8, loadWord(out + i * 8) ^ loadWord(in + i * 8));
+    }
+}
+
+class SnapshotEncoder
+{
+public:
+    static const uint32_t DEFAULT_KEYFRAME_INTERVAL = 60;
+
+    // A keyframe is sent every (keyframeInterval) snapshots, or never if 0
+    explicit SnapshotEncoder(uint32_t keyframeInterval = DEFAULT_KEYFRAME_INTERVAL) : m_keyframeInterval(keyframeInterval) {}
+
+    // Encodes (size) bytes at (state). The result is valid until the next call.
+    inline const std::vector<uint8_t>& encode(const void* state, size_t size);
+
+    // Makes the next snapshot a keyframe, e.g. when a follower reports a missed snapshot
+    void requestKeyframe() { m_keyframeRequested = true; }
+    void setKeyframeInterval(uint32_t interval) { m_keyframeInterval = interval; }
+
+    uint64_t sequence() const { return m_sequence; }
+    const SnapshotStats& stats() const { return m_stats; }
+
+private:
+    std::vector<uint8_t> m_reference; // state of the last snapshot
+    std::vector<uint8_t> m_encoded;
+    uint64_t m_sequence = 0;
+    uint32_t m_keyframeInterval;
+    uint32_t m_sinceKeyframe = 0;
+    bool m_keyframeRequested = true;
+    SnapshotStats m_stats;
+};
+
+class SnapshotDecoder
+{
+public:
+    // Applies (snapshot) to the current state. Returns false, leaving the state untouched, if (snapshot) is a delta
+    // against a snapshot this decoder did not see; decoding resumes at the next keyframe. Throws if (snapshot) is malformed.
+    inline bool decode(const void* snapshot, size_t size);
+
+    // The state as of the last successfully decoded snapshot
+    const std::vector<uint8_t>& state() const { return m_state; }
+    uint64_t sequence() const { return m_sequence; }
+    // Set after a snapshot could not be decoded, until the next keyframe
+    bool needsKeyframe() const { return m_needsKeyframe; }
+    const SnapshotStats& stats() const { return m_stats; }
+
+private:
+    std::vector<uint8_t> m_state;
+    uint64_t m_sequence = 0;
+    bool m_needsKeyframe = true;
+    SnapshotStats m_stats;
+};
+
+const std::vector<uint8_t>& SnapshotEncoder::encode(const void* state, size_t size)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const uint8_t* current = static_cast<const uint8_t*>(state);
+
+    const bool keyframe = m_keyframeRequested || m_reference.size() != size || (m_keyframeInterval > 0 && m_sinceKeyframe + 1 >= m_keyframeInterval);
+    if (keyframe)
+        m_reference.resize(size);
+
+    rs_detail::SnapshotHeader header = {};
+    header.magic = rs_detail::SNAPSHOT_MAGIC;
+    header.flags = keyframe ? rs_detail::SNAPSHOT_KEYFRAME : 0;
+    header.baseSequence = keyframe ? 0 : m_sequence;
+    header.sequence = ++m_sequence;
+    header.size = size;
+
+    // Grown on demand, as the worst case is larger than the state
+    if (m_encoded.size() < sizeof(header) + size / 2 + 64)
+        m_encoded.resize(sizeof(header) + size / 2 + 64);
+    size_t pos = sizeof(header);
+    auto reserve = [&](size_t bytes) {
+        if (pos + bytes > m_encoded.size())
+            m_encoded.resize(std::max(m_encoded.size() * 2, pos + bytes));
+    };
+
+    // Alternating (unchanged word count, changed word count, changed words XOR the reference) until the state is covered.
+    // The reference is updated as it is scanned, leaving it equal to (state).
+    // A keyframe is a delta against zeros, sent as a single run of changed words to save scanning and XORing the state.
+    uint8_t* reference = m_reference.data();
+    const size_t nWords = size / 8;
+    if (keyframe && nWords > 0)
+    {
+        reserve(20 + nWords * 8);
+        uint8_t* out = rs_detail::writeVarint(m_encoded.data() + pos, 0);
+        out = rs_detail::writeVarint(out, nWords);
+        memcpy(out, current, nWords * 8);
+        memcpy(reference, current, nWords * 8);
+        pos = (out - m_encoded.data()) + nWords * 8;
+    }
+    for (size_t iWord = keyframe ? nWords : 0; iWord < nWords;)
+    {
+        const size_t nEqual = rs_detail::countEqualWords(current, reference, iWord, nWords);
+        const size_t firstChanged = iWord + nEqual;
+        const size_t nChanged = rs_detail::countChangedWords(current, reference, firstChanged, nWords);
+
+        reserve(20 + nChanged * 8);
+        uint8_t* out = rs_detail::writeVarint(m_encoded.data() + pos, nEqual);
+        out = rs_detail::writeVarint(out, nChanged);
+        memcpy(out, current + firstChanged * 8, nChanged * 8);
+        rs_detail::xorWords(out, reference + firstChanged * 8, nChanged);
+        memcpy(reference + firstChanged * 8, current + firstChanged * 8, nChanged * 8);
+        pos = (out - m_encoded.data()) + nChanged * 8;
+        iWord = firstChanged + nChanged;
+    }
+
+    // Bytes after the last whole word are always sent as they are
+    const size_t tail = size - nWords * 8;
+    if (tail > 0)
+    {
+        reserve(tail);
+        memcpy(m_encoded.data() + pos, current + nWords * 8, tail);
+        memcpy(reference + nWords * 8, current + nWords * 8, tail);
+        pos += tail;
+    }
+
+    memcpy(m_encoded.data(), &header, sizeof(header));
+    m_encoded.resize(pos);
+
+    m_keyframeRequested = false;
+    m_sinceKeyframe = keyframe ? 0 : m_sinceKeyframe + 1;
+    ++m_stats.snapshots;
+    m_stats.keyframes += keyframe ? 1 : 0;
+    m_stats.rawBytes += size;
+    m_stats.encodedBytes += pos;
+    m_stats.lastRatio = double(size) / double(pos);
+    m_stats.lastSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return m_encoded;
+}
+
+bool SnapshotDecoder::decode(const void* snapshot, size_t size)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const uint8_t* in = static_cast<const uint8_t*>(snapshot);
+    const uint8_t* end = in + size;
+
+    rs_detail::SnapshotHeader header;
+    if (size < sizeof(header))
+        throw std::runtime_error("Snapshot too small");
+    memcpy(&header, in, sizeof(header));
+    if (header.magic != rs_detail::SNAPSHOT_MAGIC)
+        throw std::runtime_error("Not a snapshot");
+    in += sizeof(header);
+
+    const bool keyframe = header.flags & rs_detail::SNAPSHOT_KEYFRAME;
+    if (!keyframe && (m_needsKeyframe || header.baseSequence != m_sequence || header.size != m_state.size()))
+    {
+        m_needsKeyframe = true;
+        return false;
+    }
+
+    // A malformed snapshot may have been partly applied, so the state is only valid again after a keyframe
+    auto malformed = [&]() {
+        m_needsKeyframe = true;
+        return std::runtime_error("Malformed snapshot");
+    };
+    if (keyframe)
+        m_state.resize(size_t(header.size));
+
+    const size_t nWords = size_t(header.size) / 8;
+    size_t iWord = 0;
+    while (iWord < nWords)
+    {
+        uint64_t nEqual, nChanged;
+        in = rs_detail::readVarint(in, end, nEqual);
+        if (in)
+            in = rs_detail::readVarint(in, end, nChanged);
+        if (!in || nEqual > nWords - iWord || nChanged > nWords - iWord - nEqual || uint64_t(end - in) < nChanged * 8)
+            throw malformed();
+        // Keyframes are against zeros, so their words are copied rather than XORed into the previous state
+        if (keyframe)
+            memset(m_state.data() + iWord * 8, 0, size_t(nEqual) * 8);
+        iWord += size_t(nEqual);
+        if (keyframe)
+            memcpy(m_state.data() + iWord * 8, in, size_t(nChanged) * 8);
+        else
+            rs_detail::xorWords(m_state.data() + iWord * 8, in, size_t(nChanged));
+        in += nChanged * 8;
+        iWord += size_t(nChanged);
+    }
+
+    const size_t tail = size_t(header.size) - nWords * 8;
+    if (size_t(end - in) != tail)
+        throw malformed();
+    if (tail > 0)
+        memcpy(m_state.data() + nWords * 8, in, tail);
+
+    m_sequence = header.sequence;
+    m_needsKeyframe = false;
+
+    ++m_stats.snapshots;
+    m_stats.keyframes += keyframe ? 1 : 0;
+    m_stats.rawBytes += header.size;
+    m_stats.encodedBytes += size;
+    m_stats.lastRatio = double(header.size) / double(size);
+    m_stats.lastSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "renderstream.hpp"
+
+#include <cmath>
+
+// Exact frame arithmetic at the frame rate d3 requests frames at. tTracked is rounded to a whole frame index once, and
+// everything after that is integer, so periodic effects stay in phase across nodes however long a show runs, where
+// floating point maths on tTracked (fmod(tTracked, period)) drifts by the rounding error of ever larger times.
+class FrameTimebase
+{
+public:
+    explicit FrameTimebase(const FrameData& frame) : FrameTimebase(frame.frameRateNumerator, frame.frameRateDenominator) {}
+    // (numerator) / (denominator) frames per second
+    inline FrameTimebase(uint32_t numerator, uint32_t denominator);
+
+    uint32_t numerator() const { return m_numerator; }
+    uint32_t denominator() const { return m_denominator; }
+    bool operator==(const FrameTimebase& other) const { return uint64_t(m_numerator) * other.m_denominator == uint64_t(other.m_numerator) * m_denominator; }
+    bool operator!=(const FrameTimebase& other) const { return !(*this == other); }
+
+    // The frame nearest (tTracked)
+    inline int64_t frameIndex(double tTracked) const;
+    int64_t frameIndex(const FrameData& frame) const { return frameIndex(frame.tTracked); }
+    // Start of (frame), in seconds
+    double seconds(int64_t frame) const { return double(frame) * m_denominator / m_numerator; }
+    double frameSeconds() const { return double(m_denominator) / m_numerator; }
+
+    // Position of (frame) within a period of (periodNumerator) / (periodDenominator) seconds, in [0, 1).
+    // Exact as long as periodNumerator * frame rate numerator fits in 32 bits.
+    inline double phase(int64_t frame, uint32_t periodNumerator, uint32_t periodDenominator = 1) const;
+
+private:
+    uint32_t m_numerator;
+    uint32_t m_denominator;
+};
+
+// Runs a simulation at a fixed number of steps per frame, with every step numbered from the start of the timeline. Steps
+// are derived from tTracked, so every node runs the same steps with the same index for the same frame, and after dropped
+// frames runs the steps it missed before the new frame's.
+//
+//     FixedStepDriver driver(4);  // 240 Hz simulation for a 60 Hz frame rate
+//     ...
+//     if (frameData.flags & FRAMEDATA_RESET) ... reset the simulation state ...
+//     driver.advance(frameData, [&](int64_t step, double dt) { simulate(step, dt); });
+//
+// Catching up is bounded to (maxSteps) per frame; past that the driver skips the oldest missed steps, so a node which
+// falls far behind rejoins the others' step index rather than running ever further behind them.
+class FixedStepDriver
+{
+public:
+    static const uint32_t DEFAULT_MAX_STEPS = 8;
+
+    struct Stats
+    {
+        uint64_t frames = 0;
+        uint64_t steps = 0;
+        uint64_t skipped = 0; // missed steps not run, because there were more than maxSteps
+        uint64_t resets = 0; // FRAMEDATA_RESET, time going backwards, or the frame rate changing
+    };
+
+    // (maxSteps) includes the steps of the frame itself, and is at least (stepsPerFrame)
+    explicit FixedStepDriver(uint32_t stepsPerFrame = 1, uint32_t maxSteps = DEFAULT_MAX_STEPS)
+        : m_stepsPerFrame(std::max(stepsPerFrame, 1u)), m_maxSteps(std::max(maxSteps, m_stepsPerFrame)) {}
+
+    // Calls step(int64_t step, double dt) for every step due up to the end of (frame), in order, and returns the number
+    // of steps run. The first frame, and every reset, runs only the frame's own steps; the same frame again runs none.
+    template <typename Fn>
+    uint32_t advance(const FrameData& frame, Fn&& step);
+
+    // Index of the next step to run
+    int64_t nextStep() const { return m_nextStep; }
+    // Seconds per step, in the current timebase
+    double stepSeconds() const { return m_timebase.frameSeconds() / m_stepsPerFrame; }
+    Stats stats() const { return m_stats; }
+
+private:
+    uint32_t m_stepsPerFrame;
+    uint32_t m_maxSteps;
+    FrameTimebase m_timebase = FrameTimebase(1, 1);
+    bool m_started = false;
+    int64_t m_nextStep = 0;
+    Stats m_stats;
+};
+
+FrameTimebase::FrameTimebase(uint32_t numerator, uint32_t denominator)
+    : m_numerator(numerator), m_denominator(denominator)
+{
+    if (numerator == 0 || denominator == 0)
+        throw std::runtime_error("Invalid frame rate " + std::to_string(numerator) + "/" + std::to_string(denominator));
+}
+
+int64_t FrameTimebase::frameIndex(double tTracked) const
+{
+    return int64_t(std::llround(tTracked * m_numerator / m_denominator));
+}
+
+double FrameTimebase::phase(int64_t frame, uint32_t periodNumerator, uint32_t periodDenominator) const
+{
+    // frame * denominator / numerator seconds, over a period of periodNumerator / periodDenominator seconds, is
+    // frame * denominator * periodDenominator / (periodNumerator * numerator) periods
+    const uint64_t period = uint64_t(periodNumerator) * m_numerator;
+    if (period == 0)
+        throw std::runtime_error("Invalid period");
+    const uint64_t step = uint64_t(m_denominator) * periodDenominator % period;
+    int64_t remainder = frame % int64_t(period);
+    if (remainder < 0)
+        remainder += int64_t(period);
+    const uint64_t position = uint64_t(remainder) * step % period;
+    return double(position) / double(period);
+}
+
+template <typename Fn>
+uint32_t FixedStepDriver::advance(const FrameData& frame, Fn&& step)
+{
+    const FrameTimebase timebase(frame);
+    const int64_t frameIndex = timebase.frameIndex(frame);
+    const int64_t firstStep = frameIndex * m_stepsPerFrame;
+    const int64_t endStep = firstStep + m_stepsPerFrame;
+
+    m_stats.frames++;
+    if (!m_started || (frame.flags & FRAMEDATA_RESET) || timebase != m_timebase || m_nextStep > endStep)
+    {
+        if (m_started)
+            m_stats.resets++;
+        m_started = true;
+        m_timebase = timebase;
+        m_nextStep = firstStep;
+    }
+    else if (endStep - m_nextStep > int64_t(m_maxSteps))
+    {
+        m_stats.skipped += uint64_t(endStep - m_maxSteps - m_nextStep);
+        m_nextStep = endStep - m_maxSteps;
+    }
+
+    const double dt = stepSeconds();
+    uint32_t nSteps = 0;
+    for (; m_nextStep < endStep; ++m_nextStep, ++nSteps)
+        step(m_nextStep, dt);
+    m_stats.steps += nSteps;
+    return nSteps;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "renderstream.hpp"
+#include "renderstream_math.hpp"
+
+// Translation, rotation and scale of a pose or transform parameter.
+struct TransformComponents
+{
+    float x, y, z;
+    float rx, ry, rz, rw; // unit quaternion
+    float sx, sy, sz; // always 1 for poses, which carry no scale
+};
+
+// Decomposes the pose and transform parameters of each scene into translation, rotation and scale.
+// Parameters are only decomposed again when their floats change, all changed parameters of a scene in one SIMD batch.
+class TransformParameterCache
+{
+public:
+    // Decomposes the changed pose and transform parameters. Call once per frame, after getFrameParameters.
+    inline void update(ParameterValues& values);
+
+    // Components of the parameter (key) in the scene last passed to update.
+    inline const TransformComponents& get(const std::string& key) const;
+
+    // Number of parameters decomposed in the last update
+    size_t decomposedCount() const { return m_batchKeys.size(); }
+
+private:
+    struct Scene
+    {
+        std::unordered_map<std::string, TransformComponents> components; // keyed by parameter key
+    };
+
+    Scene* m_current = nullptr;
+    std::unordered_map<uint64_t, Scene> m_scenes; // keyed by scene hash
+    std::vector<const char*> m_batchKeys;
+    AffineArrays m_batch;
+    TRSArrays m_decomposed;
+};
+
+void TransformParameterCache::update(ParameterValues& values)
+{
+    const RemoteParameters& scene = values.scene();
+    m_current = &m_scenes[scene.hash];
+
+    m_batchKeys.clear();
+    for (uint32_t iParam = 0; iParam < scene.nParameters; ++iParam)
+    {
+        const RemoteParameter& param = scene.parameters[iParam];
+        if ((param.type != RS_PARAMETER_POSE && param.type != RS_PARAMETER_TRANSFORM) || (param.flags & REMOTEPARAMETER_READ_ONLY))
+            continue;
+
+        if (values.changed(param.key) || m_current->components.find(param.key) == m_current->components.end())
+            m_batchKeys.push_back(param.key);
+    }
+
+    m_batch.resize(m_batchKeys.size());
+    for (size_t i = 0; i < m_batchKeys.size(); ++i)
+        m_batch.set(i, values.matrix(m_batchKeys[i]));
+
+    rsDecomposeAffine(m_batch, m_decomposed);
+
+    for (size_t i = 0; i < m_batchKeys.size(); ++i)
+    {
+        m_current->components[m_batchKeys[i]] = {
+            m_decomposed.x[i], m_decomposed.y[i], m_decomposed.z[i],
+            m_decomposed.rx[i], m_decomposed.ry[i], m_decomposed.rz[i], m_decomposed.rw[i],
+            m_decomposed.sx[i], m_decomposed.sy[i], m_decomposed.sz[i]
+        };
+    }
+}
+
+const TransformComponents& TransformParameterCache::get(const std::string& key) const
+{
+    if (!m_current)
+        throw std::logic_error("TransformParameterCache::update has not been called");
+
+    auto it = m_current->components.find(key);
+    if (it == m_current->components.end())
+        throw std::runtime_error("Key is not a transform or pose");
+    return it->second;
+}
@@ -0,0 +1,559 @@
+// Emulates a RenderStream cluster on one machine, to measure the overhead of follower replication without booking a cluster.
+// One process acts as the controller and the others as followers, each against its own stand-in for d3renderstream.dll
+// which requests frames at a fixed rate, with configurable frame drops and jitter. When every node has finished, reports
+// how far apart the nodes completed each frame and, for each follower, the replication bandwidth, the end-to-end latency
+// from the controller receiving a frame request to the follower completing it, and how far from the controller it did.
+//
+// Usage: ClusterEmulator.exe [--nodes 4] [--frames 600] [--fps 60] [--drop 0.01] [--jitter-ms 2] [--render-ms 4]
+//                            [--state-bytes 1048576] [--change 0.01] [--delta] [--transport tcp|udp|shm]
+
+#include "../../include/renderstream.hpp"
+#include "../../include/renderstream_followers.hpp"
+#include "../../include/renderstream_snapshots.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+struct Options
+{
+    uint32_t nodes = 4;
+    uint32_t frames = 600;
+    double fps = 60;
+    double drop = 0.01; // probability of the controller's dll dropping each frame
+    double jitterMs = 2; // maximum random delay added to each frame request, on every node
+    double renderMs = 4;
+    size_t stateBytes = 1 << 20;
+    double change = 0.01; // fraction of the state modified each frame
+    bool delta = false;
+    std::string transport = "tcp";
+
+    // Set by the launcher for each node
+    int32_t node = -1;
+    int64_t startUs = 0;
+    std::string report;
+};
+
+static int64_t nowUs()
+{
+    // QueryPerformanceCounter, which is consistent between processes
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void waitUntil(int64_t us)
+{
+    // Sleep is too coarse to emulate frame timing, so spin for the last couple of milliseconds
+    while (true)
+    {
+        const int64_t remaining = us - nowUs();
+        if (remaining <= 0)
+            return;
+        if (remaining > 2000)
+            std::this_thread::sleep_for(std::chrono::microseconds(remaining - 2000));
+        else
+            std::this_thread::yield();
+    }
+}
+
+// Stand-in for the rs_* functions of d3renderstream.dll, with one stream and no parameters.
+namespace emulator
+{
+    struct FrameRecord
+    {
+        double tTracked;
+        int64_t requestedUs; // frame request returned to the engine
+        int64_t completedUs; // rs_sendFrame2
+    };
+
+    Options g_options;
+    std::mt19937 g_random;
+    uint32_t g_frame = 0;
+    bool g_streamsSent = false;
+    uint64_t g_dropped = 0;
+    int64_t g_requestedUs = 0;
+    std::vector<FrameRecord> g_records;
+
+    void jitter()
+    {
+        std::uniform_real_distribution<double> delay(0, g_options.jitterMs * 1000);
+        waitUntil(nowUs() + int64_t(delay(g_random)));
+    }
+
+    RS_ERROR awaitFrameData(int /*timeoutMs*/, FrameData* data)
+    {
+        if (!g_streamsSent)
+        {
+            g_streamsSent = true;
+            return RS_ERROR_STREAMS_CHANGED;
+        }
+
+        std::bernoulli_distribution drop(g_options.drop);
+        do
+        {
+            ++g_frame;
+        } while (g_frame <= g_options.frames && drop(g_random) && ++g_dropped);
+        if (g_frame > g_options.frames)
+            return RS_ERROR_QUIT;
+
+        waitUntil(g_options.startUs + int64_t(g_frame * 1e6 / g_options.fps));
+        jitter();
+        *data = {};
+        data->tTracked = g_frame / g_options.fps;
+        data->localTime = data->tTracked;
+        data->localTimeDelta = 1 / g_options.fps;
+        data->frameRateNumerator = uint32_t(g_options.fps);
+        data->frameRateDenominator = 1;
+        g_requestedUs = nowUs();
+        return RS_ERROR_SUCCESS;
+    }
+
+    RS_ERROR beginFollowerFrame(double /*tTracked*/)
+    {
+        if (!g_streamsSent)
+        {
+            g_streamsSent = true;
+            return RS_ERROR_STREAMS_CHANGED;
+        }
+        jitter();
+        g_requestedUs = nowUs();
+        return RS_ERROR_SUCCESS;
+    }
+
+    RS_ERROR getStreams(StreamDescriptions* streams, uint32_t* nBytes)
+    {
+        const uint32_t required = sizeof(StreamDescriptions) + sizeof(StreamDescription);
+        if (!streams || *nBytes < required)
+        {
+            *nBytes = required;
+            return RS_ERROR_BUFFER_OVERFLOW;
+        }
+        StreamDescription* description = reinterpret_cast<StreamDescription*>(streams + 1);
+        *description = {};
+        description->handle = 1;
+        description->channel = "Default";
+        description->name = "Emulated";
+        description->width = 64;
+        description->height = 64;
+        description->format = RS_FMT_BGRA8;
+        description->clipping = { 0, 1, 0, 1 };
+        description->mappingName = "Emulated";
+        streams->nStreams = 1;
+        streams->streams = description;
+        *nBytes = required;
+        return RS_ERROR_SUCCESS;
+    }
+
+    RS_ERROR getFrameCamera(StreamHandle stream, CameraData* camera)
+    {
+        *camera = {};
+        camera->id = stream;
+        camera->focalLength = 30;
+        camera->sensorX = 36;
+        camera->sensorY = 24;
+        camera->nearZ = 0.1f;
+        camera->farZ = 1000;
+        return RS_ERROR_SUCCESS;
+    }
+
+    RS_ERROR sendFrame2(StreamHandle /*stream*/, const SenderFrame* /*frame*/, const FrameResponseData* response)
+    {
+        g_records.push_back({ response->cameraData->tTracked, g_requestedUs, nowUs() });
+        return RS_ERROR_SUCCESS;
+    }
+
+    RS_ERROR success() { return RS_ERROR_SUCCESS; }
+    void noLogger(logger_t) {}
+    void noUnregister() {}
+
+#define EMULATED(FUNC_NAME, ...) { "rs_" #FUNC_NAME, reinterpret_cast<void*>(static_cast<decltype(rs_ ## FUNC_NAME)*>(__VA_ARGS__)) }
+
+    void* resolve(const char* name)
+    {
+        static const std::unordered_map<std::string, void*> functions = {
+            EMULATED(registerLoggingFunc, noLogger),
+            EMULATED(registerErrorLoggingFunc, noLogger),
+            EMULATED(registerVerboseLoggingFunc, noLogger),
+            EMULATED(unregisterLoggingFunc, noUnregister),
+            EMULATED(unregisterErrorLoggingFunc, noUnregister),
+            EMULATED(unregisterVerboseLoggingFunc, noUnregister),
+            EMULATED(initialise, [](int, int) { return RS_ERROR_SUCCESS; }),
+            EMULATED(initialiseGpGpuWithDX11Device, [](ID3D11Device*) { return RS_ERROR_FAILED_TO_INITIALISE_GPGPU; }),
+            EMULATED(initialiseGpGpuWithDX11Resource, [](ID3D11Resource*) { return RS_ERROR_FAILED_TO_INITIALISE_GPGPU; }),
+            EMULATED(initialiseGpGpuWithDX12DeviceAndQueue, [](ID3D12Device*, ID3D12CommandQueue*) { return RS_ERROR_FAILED_TO_INITIALISE_GPGPU; }),
+            EMULATED(initialiseGpGpuWithOpenGlContexts, [](HGLRC, HDC) { return RS_ERROR_FAILED_TO_INITIALISE_GPGPU; }),
+            EMULATED(initialiseGpGpuWithoutInterop, [](ID3D11Device*) { return RS_ERROR_SUCCESS; }),
+            EMULATED(loadSchema, [](const char*, Schema*, uint32_t*) { return RS_ERROR_NOTFOUND; }),
+            EMULATED(saveSchema, [](const char*, Schema*) { return RS_ERROR_SUCCESS; }),
+            EMULATED(setSchema, [](Schema*) { return RS_ERROR_SUCCESS; }),
+            EMULATED(getStreams, getStreams),
+            EMULATED(getFrameParameters, [](uint64_t, void*, uint64_t) { return RS_ERROR_SUCCESS; }),
+            EMULATED(getFrameImageData, [](uint64_t, ImageFrameData*, uint64_t) { return RS_ERROR_SUCCESS; }),
+            EMULATED(getFrameText, [](uint64_t, uint32_t, const char**) { return RS_ERROR_NOTFOUND; }),
+            EMULATED(getFrameImage2, [](int64_t, const SenderFrame*) { return RS_ERROR_NOTFOUND; }),
+            EMULATED(releaseImage2, [](const SenderFrame*) { return RS_ERROR_SUCCESS; }),
+            EMULATED(awaitFrameData, awaitFrameData),
+            EMULATED(setFollower, [](int) { return RS_ERROR_SUCCESS; }),
+            EMULATED(beginFollowerFrame, beginFollowerFrame),
+            EMULATED(getFrameCamera, getFrameCamera),
+            EMULATED(sendFrame2, sendFrame2),
+            EMULATED(setNewStatusMessage, [](const char*) { return RS_ERROR_SUCCESS; }),
+            EMULATED(shutdown, success),
+        };
+        auto it = functions.find(name);
+        return it != functions.end() ? it->second : nullptr;
+    }
+
+#undef EMULATED
+}
+
+// Counts the bytes the controller publishes
+class CountingTransport : public FollowerTransport
+{
+public:
+    explicit CountingTransport(std::unique_ptr<FollowerTransport> transport) : m_transport(std::move(transport)) {}
+
+    void send(const uint8_t* data, size_t size) override
+    {
+        m_bytes += size;
+        m_transport->send(data, size);
+    }
+    bool receive(std::vector<uint8_t>& out, int timeoutMs) override
+    {
+        if (!m_transport->receive(out, timeoutMs))
+            return false;
+        m_bytes += out.size();
+        return true;
+    }
+
+    // Sent by a controller, or received by a follower
+    uint64_t bytes() const { return m_bytes; }
+
+private:
+    std::unique_ptr<FollowerTransport> m_transport;
+    uint64_t m_bytes = 0;
+};
+
+struct NodeReport
+{
+    uint32_t node;
+    uint32_t nRecords;
+    uint64_t bytes; // published by the controller, received by followers
+    uint64_t droppedByDll; // controller
+    uint64_t droppedInTransit; // followers
+    double seconds;
+};
+
+static const uint16_t PORT = 7890;
+static const char* MULTICAST_GROUP = "239.255.42.99";
+
+static std::unique_ptr<FollowerTransport> makeTransport(const Options& options, bool controller)
+{
+    const std::string shmName = "ClusterEmulator" + std::to_string(options.startUs);
+    if (options.transport == "tcp")
+        return std::make_unique<TcpFollowerTransport>(controller ? TcpFollowerTransport::controller(PORT) : TcpFollowerTransport::follower("127.0.0.1", PORT));
+    if (options.transport == "udp")
+        return std::make_unique<UdpFollowerTransport>(controller ? UdpFollowerTransport::controller(MULTICAST_GROUP, PORT) : UdpFollowerTransport::follower(MULTICAST_GROUP, PORT));
+    if (options.transport == "shm")
+        return std::make_unique<SharedMemoryFollowerTransport>(controller ? SharedMemoryFollowerTransport::controller(shmName.c_str(), options.stateBytes + 4096) : SharedMemoryFollowerTransport::follower(shmName.c_str()));
+    throw std::runtime_error("Unknown transport '" + options.transport + "'");
+}
+
+static void render(RenderStream& rs, const Options& options, double tTracked)
+{
+    waitUntil(nowUs() + int64_t(options.renderMs * 1000));
+
+    const StreamTable& streams = rs.streams();
+    for (uint32_t slot = 0; slot < streams.capacity(); ++slot)
+    {
+        if (!streams.used(slot))
+            continue;
+        CameraResponseData cameraData;
+        cameraData.tTracked = tTracked;
+        cameraData.camera = rs.getFrameCamera(streams.handles[slot]);
+        SenderFrame frame = {};
+        frame.type = RS_FRAMETYPE_UNKNOWN;
+        FrameResponseData response = {};
+        response.cameraData = &cameraData;
+        rs.sendFrame(streams.handles[slot], frame, response);
+    }
+}
+
+static int runNode(const Options& options)
+{
+    emulator::g_options = options;
+    emulator::g_random.seed(uint32_t(options.node) + 1);
+
+    RenderStream rs;
+    rs.initialise(emulator::resolve);
+    rs.initialiseGpGpuWithoutInterop();
+
+    NodeReport report = {};
+    report.node = uint32_t(options.node);
+    const bool isController = options.node == 0;
+    if (isController)
+    {
+        auto counting = std::make_unique<CountingTransport>(makeTransport(options, true));
+        CountingTransport& transport = *counting;
+        FollowerController controller(std::move(counting));
+        SnapshotEncoder encoder;
+        std::vector<uint8_t> state(options.stateBytes);
+        std::mt19937 random(1234);
+        const size_t nChanged = size_t(options.change * double(state.size()));
+
+        while (true)
+        {
+            auto awaitResult = rs.awaitFrameData(5000);
+            if (std::holds_alternative<RS_ERROR>(awaitResult))
+            {
+                const RS_ERROR err = std::get<RS_ERROR>(awaitResult);
+                if (err == RS_ERROR_STREAMS_CHANGED)
+                {
+                    rs.getStreams();
+                    continue;
+                }
+                if (err == RS_ERROR_QUIT)
+                    break;
+                throw RenderStreamError(err, "awaitFrameData");
+            }
+
+            // Simulate
+            const FrameData& frameData = std::get<FrameData>(awaitResult);
+            for (size_t i = 0; i < nChanged; ++i)
+                state[random() % state.size()] = uint8_t(random());
+
+            if (options.delta)
+            {
+                const std::vector<uint8_t>& snapshot = encoder.encode(state.data(), state.size());
+                controller.publish(frameData, snapshot.data(), snapshot.size());
+            }
+            else
+            {
+                controller.publish(frameData, state.data(), state.size());
+            }
+            render(rs, options, frameData.tTracked);
+        }
+        report.bytes = transport.bytes();
+        report.droppedByDll = emulator::g_dropped;
+    }
+    else
+    {
+        auto counting = std::make_unique<CountingTransport>(makeTransport(options, false));
+        CountingTransport& transport = *counting;
+        Follower follower(rs, std::move(counting));
+        SnapshotDecoder decoder;
+        const double lastTracked = options.frames / options.fps;
+        // The controller may not be publishing, or even listening, until shortly after the start time
+        const int64_t giveUpUs = options.startUs + 10000000;
+        while (true)
+        {
+            auto awaitResult = follower.awaitFrame(2000);
+            if (std::holds_alternative<RS_ERROR>(awaitResult))
+            {
+                const RS_ERROR err = std::get<RS_ERROR>(awaitResult);
+                if (err == RS_ERROR_STREAMS_CHANGED)
+                {
+                    rs.getStreams();
+                    continue;
+                }
+                if (err == RS_ERROR_TIMEOUT)
+                {
+                    if (follower.stats().frames > 0 || nowUs() > giveUpUs)
+                        break; // the controller has finished
+                    continue;
+                }
+                throw RenderStreamError(err, "beginFollowerFrame");
+            }
+
+            const FrameData& frameData = std::get<FrameData>(awaitResult);
+            if (options.delta)
+                decoder.decode(follower.lastFrame().state.data(), follower.lastFrame().state.size());
+            render(rs, options, frameData.tTracked);
+            if (frameData.tTracked >= lastTracked)
+                break;
+        }
+        report.droppedInTransit = follower.stats().dropped;
+        report.bytes = transport.bytes();
+    }
+
+    report.seconds = double(nowUs() - options.startUs) * 1e-6;
+    report.nRecords = uint32_t(emulator::g_records.size());
+    std::ofstream out(options.report, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(&report), sizeof(report));
+    out.write(reinterpret_cast<const char*>(emulator::g_records.data()), emulator::g_records.size() * sizeof(emulator::FrameRecord));
+    return 0;
+}
+
+static double percentile(std::vector<double> values, double p)
+{
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, size_t(p * double(values.size())))];
+}
+
+static void printDistribution(const char* name, const std::vector<double>& values)
+{
+    printf("%-22s p50 %8.3f ms   p95 %8.3f ms   p99 %8.3f ms   max %8.3f ms   (%zu samples)\n", name,
+        percentile(values, 0.5), percentile(values, 0.95), percentile(values, 0.99), percentile(values, 1.0), values.size());
+}
+
+static int runCluster(const Options& options, const std::string& arguments)
+{
+    char exePath[MAX_PATH];
+    GetModuleFileNameA(nullptr, exePath, MAX_PATH);
+    char tempPath[MAX_PATH];
+    GetTempPathA(MAX_PATH, tempPath);
+
+    // Give every node time to start and connect before the first frame
+    const int64_t startUs = nowUs() + 2000000;
+    std::vector<PROCESS_INFORMATION> processes(options.nodes);
+    std::vector<std::string> reports(options.nodes);
+    for (uint32_t node = 0; node < options.nodes; ++node)
+    {
+        reports[node] = std::string(tempPath) + "ClusterEmulator_" + std::to_string(GetCurrentProcessId()) + "_" + std::to_string(node) + ".bin";
+        std::string commandLine = "\"" + std::string(exePath) + "\"" + arguments + " --node " + std::to_string(node) + " --start " + std::to_string(startUs) + " --report \"" + reports[node] + "\"";
+        STARTUPINFOA startup = { sizeof(startup) };
+        if (!CreateProcessA(nullptr, &commandLine[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startup, &processes[node]))
+            throw std::runtime_error("Failed to start node " + std::to_string(node));
+    }
+    for (PROCESS_INFORMATION& process : processes)
+    {
+        WaitForSingleObject(process.hProcess, INFINITE);
+        CloseHandle(process.hProcess);
+        CloseHandle(process.hThread);
+    }
+
+    std::vector<NodeReport> nodeReports(options.nodes);
+    std::vector<std::unordered_map<double, emulator::FrameRecord>> records(options.nodes);
+    for (uint32_t node = 0; node < options.nodes; ++node)
+    {
+        std::ifstream in(reports[node], std::ios::binary);
+        if (!in.read(reinterpret_cast<char*>(&nodeReports[node]), sizeof(NodeReport)))
+            throw std::runtime_error("Node " + std::to_string(node) + " did not report");
+        std::vector<emulator::FrameRecord> nodeRecords(nodeReports[node].nRecords);
+        in.read(reinterpret_cast<char*>(nodeRecords.data()), nodeRecords.size() * sizeof(emulator::FrameRecord));
+        for (const emulator::FrameRecord& record : nodeRecords)
+            records[node][record.tTracked] = record;
+        in.close();
+        DeleteFileA(reports[node].c_str());
+    }
+
+    // Skew between the first and last node to complete each frame every node completed, and per follower, latency from
+    // the controller receiving each frame request to the follower completing the frame, and how far the follower completed
+    // it from the controller
+    std::vector<double> skew, latency;
+    std::vector<std::vector<double>> nodeLatency(options.nodes), nodeSkew(options.nodes);
+    for (const auto& entry : records[0])
+    {
+        int64_t first = entry.second.completedUs, last = entry.second.completedUs;
+        bool everyNode = true;
+        for (uint32_t node = 1; node < options.nodes; ++node)
+        {
+            auto it = records[node].find(entry.first);
+            if (it == records[node].end())
+            {
+                everyNode = false;
+                continue;
+            }
+            first = std::min(first, it->second.completedUs);
+            last = std::max(last, it->second.completedUs);
+            latency.push_back(double(it->second.completedUs - entry.second.requestedUs) * 1e-3);
+            nodeLatency[node].push_back(latency.back());
+            nodeSkew[node].push_back(std::abs(double(it->second.completedUs - entry.second.completedUs)) * 1e-3);
+        }
+        if (everyNode)
+            skew.push_back(double(last - first) * 1e-3);
+    }
+
+    const NodeReport& controller = nodeReports[0];
+    printf("%u nodes, %s transport%s, %u frames at %.2f fps, %.1f%% dropped by the dll, %.1f ms jitter\n", options.nodes, options.transport.c_str(),
+        options.delta ? " with delta snapshots" : "", options.frames, options.fps, options.drop * 100, options.jitterMs);
+    printf("Controller: %zu frames, %llu dropped by the dll, published %.1f MB (%.1f Mbit/s)\n", records[0].size(), (unsigned long long)controller.droppedByDll,
+        controller.bytes / 1e6, controller.bytes * 8 / 1e6 / controller.seconds);
+    for (uint32_t node = 1; node < options.nodes; ++node)
+    {
+        const NodeReport& follower = nodeReports[node];
+        printf("Follower %u: %zu frames, %llu lost in transit, received %.1f MB (%.1f Mbit/s)\n", node, records[node].size(),
+            (unsigned long long)follower.droppedInTransit, follower.bytes / 1e6, follower.bytes * 8 / 1e6 / follower.seconds);
+        printDistribution("  Latency", nodeLatency[node]);
+        printDistribution("  Skew from controller", nodeSkew[node]);
+    }
+    printDistribution("Completion skew", skew);
+    printDistribution("End-to-end latency", latency);
+    return 0;
+}
+
+static Options parseOptions(int argc, char** argv, std::string& forwarded)
+{
+    Options options;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value for " + arg);
+            return argv[++i];
+        };
+
+        if (arg == "--delta")
+        {
+            options.delta = true;
+            forwarded += " " + arg;
+            continue;
+        }
+
+        const std::string v = value();
+        if (arg == "--node")
+            options.node = std::stoi(v);
+        else if (arg == "--start")
+            options.startUs = std::stoll(v);
+        else if (arg == "--report")
+            options.report = v;
+        else
+        {
+            if (arg == "--nodes")
+                options.nodes = uint32_t(std::stoul(v));
+            else if (arg == "--frames")
+                options.frames = uint32_t(std::stoul(v));
+            else if (arg == "--fps")
+                options.fps = std::stod(v);
+            else if (arg == "--drop")
+                options.drop = std::stod(v);
+            else if (arg == "--jitter-ms")
+                options.jitterMs = std::stod(v);
+            else if (arg == "--render-ms")
+                options.renderMs = std::stod(v);
+            else if (arg == "--state-bytes")
+                options.stateBytes = size_t(std::stoull(v));
+            else if (arg == "--change")
+                options.change = std::stod(v);
+            else if (arg == "--transport")
+                options.transport = v;
+            else
+                throw std::runtime_error("Unknown option " + arg);
+            forwarded += " " + arg + " " + v;
+        }
+    }
+    if (options.nodes < 2)
+        throw std::runtime_error("A cluster needs at least 2 nodes");
+    return options;
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        std::string forwarded;
+        const Options options = parseOptions(argc, argv, forwarded);
+        return options.node < 0 ? runCluster(options, forwarded) : runNode(options);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 99;
+    }
+}
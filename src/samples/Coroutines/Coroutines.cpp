@@ -0,0 +1,139 @@
+// A RenderStream application that runs its frame loop as C++20 coroutines with FrameLoop. While the first frames are
+// sent as a plain strobe, a background coroutine generates a pattern in chunks, yielding between them so that frame
+// requests are answered as they arrive. Once it is ready, the strobe is drawn through the pattern.
+//
+// Usage: Compile, copy the executable into your RenderStream Projects folder and launch via d3
+
+#include <tchar.h>
+
+#include <cmath>
+
+#include "../../include/renderstream.hpp"
+#include "../../include/renderstream_coroutines.hpp"
+#include "../../include/renderstream_timebase.hpp"
+
+#if defined(UNICODE) || defined(_UNICODE)
+#define tcout std::wcout
+#define tcerr std::wcerr
+#else
+#define tcout std::cout
+#define tcerr std::cerr
+#endif
+
+static const uint32_t PATTERN_SIZE = 1024;
+static const uint32_t PATTERN_ROWS_PER_CHUNK = 16;
+
+// Rings around the centre of a square, one byte per pixel
+Task<void> generatePattern(FrameLoop& loop, std::vector<uint8_t>& pattern, bool& ready)
+{
+    std::vector<uint8_t> rows(size_t(PATTERN_SIZE) * PATTERN_SIZE);
+    for (uint32_t y = 0; y < PATTERN_SIZE; ++y)
+    {
+        for (uint32_t x = 0; x < PATTERN_SIZE; ++x)
+        {
+            const float dx = float(x) - PATTERN_SIZE / 2.f;
+            const float dy = float(y) - PATTERN_SIZE / 2.f;
+            rows[size_t(y) * PATTERN_SIZE + x] = uint8_t(127.5f + 127.5f * std::cos(std::sqrt(dx * dx + dy * dy) / 8.f));
+        }
+        if ((y + 1) % PATTERN_ROWS_PER_CHUNK == 0)
+            co_await loop.yield();
+    }
+    pattern = std::move(rows);
+    ready = true;
+    tcout << "Pattern ready" << std::endl;
+}
+
+Task<void> watchStreams(FrameLoop& loop, const StreamDescriptions*& header)
+{
+    while (const StreamDescriptions* streams = co_await loop.streamsChanged())
+    {
+        header = streams;
+        tcout << "Found " << header->nStreams << " streams" << std::endl;
+    }
+}
+
+Task<void> renderFrames(FrameLoop& loop, RenderStream& rs, const StreamDescriptions*& header, const std::vector<uint8_t>& pattern, const bool& patternReady)
+{
+    std::vector<uint8_t> pixels;
+    while (std::optional<FrameData> frameData = co_await loop.nextFrame())
+    {
+        // Exact, so nodes stay in phase however long the show runs
+        const FrameTimebase timebase(*frameData);
+        const float strobe = float(abs(1.0 - 2.0 * timebase.phase(timebase.frameIndex(*frameData), 2)));
+
+        const size_t numStreams = header ? header->nStreams : 0;
+        for (size_t i = 0; i < numStreams; ++i)
+        {
+            const StreamDescription& description = header->streams[i];
+            if (description.format != RS_FMT_BGRA8 && description.format != RS_FMT_BGRX8)
+                continue;
+
+            CameraResponseData cameraData;
+            cameraData.tTracked = frameData->tTracked;
+            try
+            {
+                cameraData.camera = rs.getFrameCamera(description.handle);
+            }
+            catch (const RenderStreamError& e)
+            {
+                if (e.error == RS_ERROR_NOTFOUND)
+                    continue;
+                throw;
+            }
+
+            pixels.resize(size_t(description.width) * description.height * 4);
+            for (uint32_t y = 0; y < description.height; ++y)
+            {
+                for (uint32_t x = 0; x < description.width; ++x)
+                {
+                    const uint8_t shade = patternReady ? pattern[size_t(y % PATTERN_SIZE) * PATTERN_SIZE + x % PATTERN_SIZE] : 255;
+                    const uint8_t value = uint8_t(strobe * shade);
+                    uint8_t* pixel = &pixels[(size_t(y) * description.width + x) * 4];
+                    pixel[0] = pixel[1] = pixel[2] = value;
+                    pixel[3] = 255;
+                }
+            }
+
+            SenderFrame data;
+            data.type = RS_FRAMETYPE_HOST_MEMORY;
+            data.cpu.stride = description.width * 4;
+            data.cpu.format = description.format;
+            data.cpu.data = pixels.data();
+
+            FrameResponseData response = {};
+            response.cameraData = &cameraData;
+            rs.sendFrame(description.handle, data, response);
+        }
+    }
+}
+
+int mainImpl()
+{
+    RenderStream rs;
+    rs.initialise();
+    rs.initialiseGpGpuWithoutInterop();
+
+    const StreamDescriptions* header = nullptr;
+    std::vector<uint8_t> pattern;
+    bool patternReady = false;
+
+    FrameLoop loop(rs);
+    loop.spawn(watchStreams(loop, header));
+    loop.spawn(generatePattern(loop, pattern, patternReady));
+    // Returns once d3 asks the application to quit
+    loop.run(renderFrames(loop, rs, header, pattern, patternReady));
+    return 0;
+}
+
+int main()
+{
+    try
+    {
+        return mainImpl();
+    }
+    catch (const std::exception& e)
+    {
+        tcerr << "Error: " << e.what() << std::endl;
+        return 99;
+    }
+}
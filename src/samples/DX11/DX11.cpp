@@ -7,7 +7,6 @@
 #include <d3dcompiler.h>
 #include <DirectXMath.h>
 #include <wrl.h>
-#include <unordered_map>
 
 // auto-generated from hlsl
 #include "Generated_Code/VertexShader.h"
@@ -173,7 +172,7 @@ int mainImpl()
         Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
         Microsoft::WRL::ComPtr<ID3D11RenderTargetView> view;
     };
-    std::unordered_map<StreamHandle, RenderTarget> renderTargets;
+    std::vector<RenderTarget> renderTargets; // indexed by stream slot
     while (true)
     {
         // Wait for a frame request
@@ -184,12 +183,22 @@ int mainImpl()
             if (err == RS_ERROR_STREAMS_CHANGED)
             {
                 header = rs.getStreams();
-                // Create render targets for all streams
+                const StreamTable& streams = rs.streams();
+                renderTargets.resize(streams.capacity());
+                for (uint32_t slot = 0; slot < streams.capacity(); ++slot)
+                {
+                    if (streams.changes[slot] == STREAM_REMOVED)
+                        renderTargets[slot] = RenderTarget();
+                }
+                // Create render targets for new and resized streams, other streams keep theirs
                 const size_t numStreams = header ? header->nStreams : 0;
                 for (size_t i = 0; i < numStreams; ++i)
                 {
                     const StreamDescription& description = header->streams[i];
-                    RenderTarget& target = renderTargets[description.handle];
+                    if (!streams.needsResources(streams.slots[i]))
+                        continue;
+                    RenderTarget& target = renderTargets[streams.slots[i]];
+                    target = RenderTarget();
 
                     D3D11_TEXTURE2D_DESC rtDesc;
                     ZeroMemory(&rtDesc, sizeof(D3D11_TEXTURE2D_DESC));
@@ -252,7 +261,7 @@ int mainImpl()
             }
 
             {
-                const RenderTarget& target = renderTargets.at(description.handle);
+                const RenderTarget& target = renderTargets[rs.streams().slots[i]];
                 context->OMSetRenderTargets(1, target.view.GetAddressOf(), nullptr);
 
                 const float clearColour[4] = { 0.f, 0.2f, 0.f, 0.f };
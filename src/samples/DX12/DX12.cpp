@@ -349,8 +349,9 @@ int mainImpl()
         Microsoft::WRL::ComPtr<ID3D12Resource> texture;
         D3D12_CPU_DESCRIPTOR_HANDLE view;
     };
-    std::unordered_map<StreamHandle, RenderTarget> renderTargets;
+    std::vector<RenderTarget> renderTargets; // indexed by stream slot
     Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> rtvHeap;
+    size_t rtvHeapSize = 0;
     const float clearColour[4] = { 0.f, 0.2f, 0.f, 0.f };
     while (true)
     {
@@ -362,21 +363,49 @@ int mainImpl()
             if (err == RS_ERROR_STREAMS_CHANGED)
             {
                 header = rs.getStreams();
-                // Create render targets for all streams
+                const StreamTable& streams = rs.streams();
                 const size_t numStreams = header ? header->nStreams : 0;
-                D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc;
-                rtvHeapDesc.NumDescriptors = UINT(numStreams);
-                rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
-                rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-                rtvHeapDesc.NodeMask = 0;
-                if (FAILED(device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(rtvHeap.GetAddressOf()))))
-                        throw std::runtime_error("Failed to create render target descriptor heap");
-                renderTargets.clear(); // Heap handles are now stale
+                // Views are indexed by slot, so the heap only needs replacing when the table grows
+                const bool newHeap = !rtvHeap || rtvHeapSize < streams.capacity();
+                if (newHeap)
+                {
+                    D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc;
+                    rtvHeapDesc.NumDescriptors = UINT(streams.capacity());
+                    rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+                    rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+                    rtvHeapDesc.NodeMask = 0;
+                    if (FAILED(device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(rtvHeap.ReleaseAndGetAddressOf()))))
+                            throw std::runtime_error("Failed to create render target descriptor heap");
+                    rtvHeapSize = streams.capacity();
+                }
+                renderTargets.resize(streams.capacity());
+                for (uint32_t slot = 0; slot < streams.capacity(); ++slot)
+                {
+                    if (streams.changes[slot] == STREAM_REMOVED)
+                        renderTargets[slot] = RenderTarget();
+                }
                 UINT rtvDescriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+                // Create render targets for new and resized streams, other streams keep theirs
                 for (size_t i = 0; i < numStreams; ++i)
                 {
                     const StreamDescription& description = header->streams[i];
-                    RenderTarget& target = renderTargets[description.handle];
+                    const uint32_t slot = streams.slots[i];
+                    RenderTarget& target = renderTargets[slot];
+                    if (!streams.needsResources(slot))
+                    {
+                        // Heap handles are stale if the heap was replaced
+                        if (newHeap)
+                        {
+                            target.view = CD3DX12_CPU_DESCRIPTOR_HANDLE(rtvHeap->GetCPUDescriptorHandleForHeapStart(), INT(slot), rtvDescriptorSize);
+                            D3D12_RENDER_TARGET_VIEW_DESC rtvDesc;
+                            ZeroMemory(&rtvDesc, sizeof(D3D12_RENDER_TARGET_VIEW_DESC));
+                            rtvDesc.Format = target.format;
+                            rtvDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
+                            device->CreateRenderTargetView(target.texture.Get(), &rtvDesc, target.view);
+                        }
+                        continue;
+                    }
+                    target = RenderTarget();
 
                     target.format = toDxgiFormat(description.format);
 
@@ -408,7 +437,7 @@ int mainImpl()
                         IID_PPV_ARGS(target.texture.GetAddressOf()))))
                         throw std::runtime_error("Failed to create render target texture");
 
-                    target.view = CD3DX12_CPU_DESCRIPTOR_HANDLE(rtvHeap->GetCPUDescriptorHandleForHeapStart(), INT(i), rtvDescriptorSize);
+                    target.view = CD3DX12_CPU_DESCRIPTOR_HANDLE(rtvHeap->GetCPUDescriptorHandleForHeapStart(), INT(slot), rtvDescriptorSize);
 
                     D3D12_RENDER_TARGET_VIEW_DESC rtvDesc;
                     ZeroMemory(&rtvDesc, sizeof(D3D12_RENDER_TARGET_VIEW_DESC));
@@ -459,7 +488,7 @@ int mainImpl()
             }
 
             {
-                const RenderTarget& target = renderTargets.at(description.handle);
+                const RenderTarget& target = renderTargets[rs.streams().slots[i]];
                 const auto& pipelineState = pipelineStates[target.format];
 
                 commandAllocator->Reset();
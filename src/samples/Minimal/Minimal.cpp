@@ -5,6 +5,7 @@
 #include <tchar.h>
 
 #include "../../include/renderstream.hpp"
+#include "../../include/renderstream_timebase.hpp"
 
 #if defined(UNICODE) || defined(_UNICODE)
 #define tcout std::wcout
@@ -66,7 +67,9 @@ int mainImpl()
             }
             
             {
-                const float strobe = float(abs(1.0 - fmod(frameData.tTracked, 2.0)));
+                // Exact, so nodes stay in phase however long the show runs
+                const FrameTimebase timebase(frameData);
+                const float strobe = float(abs(1.0 - 2.0 * timebase.phase(timebase.frameIndex(frameData), 2)));
                 std::vector<uint8_t> pixel;
                 switch (description.format)
                 {
@@ -2,7 +2,6 @@
 //
 // Usage: Compile, copy the executable into your RenderStream Projects folder and launch via d3
 
-#include <unordered_map>
 #include <GL/gl3w.h>
 #define GLM_FORCE_LEFT_HANDED
 #include <glm/glm.hpp>
@@ -278,7 +277,7 @@ int mainImpl()
         GLuint texture;
         GLuint frameBuffer;
     };
-    std::unordered_map<StreamHandle, RenderTarget> renderTargets;
+    std::vector<RenderTarget> renderTargets; // indexed by stream slot
     while (true)
     {
         // Wait for a frame request
@@ -289,12 +288,27 @@ int mainImpl()
             if (err == RS_ERROR_STREAMS_CHANGED)
             {
                 header = rs.getStreams();
-                // Create render targets for all streams
+                const StreamTable& streams = rs.streams();
+                renderTargets.resize(streams.capacity());
+                auto release = [](RenderTarget& target) {
+                    glDeleteFramebuffers(1, &target.frameBuffer);
+                    glDeleteTextures(1, &target.texture);
+                    target = RenderTarget();
+                };
+                for (uint32_t slot = 0; slot < streams.capacity(); ++slot)
+                {
+                    if (streams.changes[slot] == STREAM_REMOVED)
+                        release(renderTargets[slot]);
+                }
+                // Create render targets for new and resized streams, other streams keep theirs
                 const size_t numStreams = header ? header->nStreams : 0;
                 for (size_t i = 0; i < numStreams; ++i)
                 {
                     const StreamDescription& description = header->streams[i];
-                    RenderTarget& target = renderTargets[description.handle];
+                    if (!streams.needsResources(streams.slots[i]))
+                        continue;
+                    RenderTarget& target = renderTargets[streams.slots[i]];
+                    release(target);
 
                     glGenTextures(1, &target.texture);
                     if (glGetError() != GL_NO_ERROR)
@@ -375,7 +389,7 @@ int mainImpl()
             }
 
             {
-                const RenderTarget& target = renderTargets.at(description.handle);
+                const RenderTarget& target = renderTargets[rs.streams().slots[i]];
                 glBindFramebuffer(GL_FRAMEBUFFER, target.frameBuffer);
 
                 glClearColor(0.f, 0.f, 0.f, 0.f);
@@ -6,6 +6,8 @@
 #include <vector>
 
 #include "../../include/renderstream.hpp"
+#include "../../include/renderstream_memory.hpp"
+#include "../../include/renderstream_outputs.hpp"
 
 #if defined(UNICODE) || defined(_UNICODE)
 #define tcout std::wcout
@@ -91,10 +93,21 @@ int mainImpl(int argc, char** argv)
     addField(scoped.schema.scenes.scenes[1].parameters[2], "stable_key_direction", "Direction", "Radar properties", 1, 0, 1, 1, { "Left", "Right" });
     rs.setSchema(&scoped.schema);
 
+    // Read-only parameters are sent back to d3 with each frame
+    std::vector<OutputParameterWriter> outputs;
+    outputs.reserve(scoped.schema.scenes.nScenes);
+    for (uint32_t i = 0; i < scoped.schema.scenes.nScenes; ++i)
+        outputs.emplace_back(scoped.schema.scenes.scenes[i]);
+
     // Saving the schema to disk makes the remote parameters available in d3's UI before the application is launched
     rs.saveSchema(argv[0], &scoped.schema);
 
     const StreamDescriptions* header = nullptr;
+    std::vector<PooledHostBuffer> frameBuffers; // indexed by stream slot
+    // Prefault frame buffers when they are allocated, rather than on the first frames after streams change
+    HostMemoryPolicy memoryPolicy;
+    memoryPolicy.prefault = true;
+    HostBufferPool::global().setPolicy(memoryPolicy);
     while (true)
     {
         // Wait for a frame request
@@ -105,6 +118,20 @@ int mainImpl(int argc, char** argv)
             if (err == RS_ERROR_STREAMS_CHANGED)
             {
                 header = rs.getStreams();
+                // Buffers of removed streams go back to the pool, where re-mapped streams of the same size pick them up
+                const StreamTable& streams = rs.streams();
+                frameBuffers.resize(streams.capacity());
+                for (uint32_t slot = 0; slot < streams.capacity(); ++slot)
+                {
+                    if (streams.changes[slot] == STREAM_REMOVED)
+                        frameBuffers[slot].reset();
+                }
+                for (size_t i = 0; i < (header ? header->nStreams : 0); ++i)
+                {
+                    const StreamDescription& description = header->streams[i];
+                    if (streams.needsResources(streams.slots[i]))
+                        frameBuffers[streams.slots[i]] = HostBufferPool::global().acquire(description.width, description.height, description.format, description.width * rsBytesPerPixel(description.format));
+                }
                 tcout << "Found " << (header ? header->nStreams : 0) << " streams" << std::endl;
                 continue;
             }
@@ -159,9 +186,9 @@ int mainImpl(int argc, char** argv)
                     uint8_t b, g, r, a;
                 };
                 static_assert(sizeof(Colour) == 4, "32-bit Colour struct");
-                std::vector<Colour> pixels;
-                std::vector<float> outParameters;
-                std::vector<const char*> outTexts;
+                PooledHostBuffer& frameBuffer = frameBuffers[rs.streams().slots[i]];
+                Colour* pixels = reinterpret_cast<Colour*>(frameBuffer.data());
+                const size_t nPixels = size_t(description.width) * description.height;
 
                 switch (frameData.scene)
                 {
@@ -179,8 +206,8 @@ int mainImpl(int argc, char** argv)
                             uint8_t(r * strobe * 255), 
                             uint8_t(a * strobe * 255) 
                         };
-                        pixels.resize(description.width * description.height, colour);
-                        outParameters.resize(1, float(strobe));
+                        std::fill(pixels, pixels + nPixels, colour);
+                        outputs[0].set("stable_key_strobe_ro", float(strobe));
                         break;
                     }
                     case 1: // "Radar"
@@ -189,7 +216,7 @@ int mainImpl(int argc, char** argv)
                         const float length = values.get<float>("stable_key_length");
                         const bool left = !values.get<float>("stable_key_direction");
                         const Colour clear = { 0, 0, 0, 0 };
-                        pixels.resize(description.width * description.height, clear);
+                        std::fill(pixels, pixels + nPixels, clear);
                         // Our stream may be sub-stream of a larger canvas, work out full canvas width
                         const float canvasWidth = float(description.width) / (description.clipping.right - description.clipping.left);
                         const int xOffset = int(description.clipping.left * canvasWidth);
@@ -216,17 +243,10 @@ int mainImpl(int argc, char** argv)
                 SenderFrame data;
                 data.type = RS_FRAMETYPE_HOST_MEMORY;
                 data.cpu.stride = description.width * sizeof(Colour);
-                data.cpu.data = reinterpret_cast<uint8_t*>(pixels.data());
+                data.cpu.data = frameBuffer.data();
                 data.cpu.format = RS_FMT_BGRA8;
 
-                FrameResponseData response = {};
-                response.cameraData = &cameraData;
-                response.schemaHash = scene.hash;
-                response.parameterDataSize = uint32_t(outParameters.size() * sizeof(float));
-                response.parameterData = outParameters.data();
-                response.textDataCount = uint32_t(outTexts.size());
-                response.textData = outTexts.data();
-                rs.sendFrame(description.handle, data, response);
+                rs.sendFrame(description.handle, data, outputs[frameData.scene].response(&cameraData));
             }
         }
     }
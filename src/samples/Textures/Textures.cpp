@@ -7,7 +7,6 @@
 #include <d3dcompiler.h>
 #include <DirectXMath.h>
 #include <wrl.h>
-#include <unordered_map>
 
 // auto-generated from hlsl
 #include "Generated_Code/VertexShader.h"
@@ -302,7 +301,7 @@ int mainImpl(int argc, char** argv)
         Microsoft::WRL::ComPtr<ID3D11Texture2D> depth;
         Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthView;
     };
-    std::unordered_map<StreamHandle, RenderTarget> renderTargets;
+    std::vector<RenderTarget> renderTargets; // indexed by stream slot
     Texture texture;
     while (true)
     {
@@ -314,12 +313,22 @@ int mainImpl(int argc, char** argv)
             if (err == RS_ERROR_STREAMS_CHANGED)
             {
                 header = rs.getStreams();
-                // Create render targets for all streams
+                const StreamTable& streams = rs.streams();
+                renderTargets.resize(streams.capacity());
+                for (uint32_t slot = 0; slot < streams.capacity(); ++slot)
+                {
+                    if (streams.changes[slot] == STREAM_REMOVED)
+                        renderTargets[slot] = RenderTarget();
+                }
+                // Create render targets for new and resized streams, other streams keep theirs
                 const size_t numStreams = header ? header->nStreams : 0;
                 for (size_t i = 0; i < numStreams; ++i)
                 {
                     const StreamDescription& description = header->streams[i];
-                    RenderTarget& target = renderTargets[description.handle];
+                    if (!streams.needsResources(streams.slots[i]))
+                        continue;
+                    RenderTarget& target = renderTargets[streams.slots[i]];
+                    target = RenderTarget();
 
                     D3D11_TEXTURE2D_DESC rtDesc;
                     ZeroMemory(&rtDesc, sizeof(D3D11_TEXTURE2D_DESC));
@@ -388,22 +397,30 @@ int mainImpl(int argc, char** argv)
         const auto& scene = scoped.schema.scenes.scenes[frameData.scene];
         ParameterValues values = rs.getFrameParameters(scene);
 
-        ImageFrameData image = values.get<ImageFrameData>("image_param1");
-        if (texture.width != image.width || texture.height != image.height)
+        // Images are identified by imageId, so only fetch when it changes
+        if (values.changed("image_param1"))
         {
-            texture = createTexture(device.Get(), image);
+            ImageFrameData image = values.get<ImageFrameData>("image_param1");
+            SenderFrame data;
+            data.type = RS_FRAMETYPE_DX11_TEXTURE;
+            if (texture.width != image.width || texture.height != image.height)
+            {
+                if (texture.resource)
+                {
+                    data.dx11.resource = texture.resource.Get();
+                    rs.releaseImage(data);
+                }
+                texture = createTexture(device.Get(), image);
+            }
+            data.dx11.resource = texture.resource.Get();
+            rs.getFrameImage(image.imageId, data);
         }
-        SenderFrame data;
-        data.type = RS_FRAMETYPE_DX11_TEXTURE;
-        data.dx11.resource = texture.resource.Get();
-        rs.getFrameImage(image.imageId, data);
 
-        DirectX::XMMATRIX transform(values.get<std::array<float, 16>>("transform_param1").data());
+        DirectX::XMMATRIX transform(values.matrix("transform_param1"));
         static_assert(sizeof(transform) == 4 * 4 * sizeof(float), "4x4 matrix");
 
-        const char* text = values.get<const char*>("text_param1");
-
-        rs.setNewStatusMessage(text);
+        if (values.changed("text_param1"))
+            rs.setNewStatusMessage(values.get<const char*>("text_param1"));
 
         // Respond to frame request
         const size_t numStreams = header ? header->nStreams : 0;
@@ -429,7 +446,7 @@ int mainImpl(int argc, char** argv)
             }
 
             {
-                const RenderTarget& target = renderTargets.at(description.handle);
+                const RenderTarget& target = renderTargets[rs.streams().slots[i]];
                 context->OMSetRenderTargets(1, target.view.GetAddressOf(), target.depthView.Get());
 
                 const float clearColour[4] = { 0.f, 0.f, 0.f, 0.f };